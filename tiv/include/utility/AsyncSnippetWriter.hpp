@@ -0,0 +1,163 @@
+#ifndef PROJET_OPENCV_CMAKE_ASYNCSNIPPETWRITER_HPP
+#define PROJET_OPENCV_CMAKE_ASYNCSNIPPETWRITER_HPP
+
+#include <vector>
+#include <thread>
+#include <set>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/core.hpp>
+
+#include "utility/BoundedQueue.hpp"
+#include "utility/SnippetInfo.hpp"
+#include "utility/SnippetSink.hpp"
+#include "utility/SnippetManifest.hpp"
+
+/*
+ * A Class saving the snippets in the background
+ * The snippets are queued by the extraction threads, encoded in PNG by dedicated threads,
+ * then written to the disk by several writer threads : the open/close latency of the files
+ * (high on network volumes) is paid by several files at once instead of one after the other
+ * Each writer takes the encoded snippets by batches, and counts them once per batch
+ * With a manifest, each snippet needs a single file instead of two
+ * It is the asynchronous version of the DiskSnippetSink
+ */
+class AsyncSnippetWriter : public SnippetSink {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor
+     * @param nbEncoders the number of threads encoding the snippets
+     * @param nbWriters the number of threads writing the files
+     * @param batchSize the maximum number of snippets taken at once by a writer
+     * @param queueCapacity the maximum number of snippets waiting to be encoded (and to be written)
+     * @param manifest if given, the metadata is appended to it instead of being written in a .txt file per snippet
+     */
+    AsyncSnippetWriter(unsigned int nbEncoders, unsigned int nbWriters, size_t batchSize, size_t queueCapacity,
+                       SnippetManifest* manifest = nullptr);
+
+    /**
+     * Destructor
+     * Waits until every queued snippet is written
+     */
+    ~AsyncSnippetWriter();
+
+    AsyncSnippetWriter(const AsyncSnippetWriter&) = delete;
+    AsyncSnippetWriter& operator=(const AsyncSnippetWriter&) = delete;
+
+//===============// Public methods //===============//
+
+    /**
+     * Queues a snippet to be saved as info.path + ".png" and info.path + ".txt"
+     * Blocks if too many snippets are waiting
+     * The pixels of the snippet are shared, not copied : they must not be modified afterwards
+     */
+    void write(const cv::Mat& snippet, const SnippetInfo& info);
+
+    /**
+     * Same as write, so that the writer can be used as the sink of the extractors
+     */
+    void consume(const cv::Mat& snippet, const SnippetInfo& info) override;
+
+    /**
+     * Blocks until every snippet queued before the call is written (or failed to be)
+     */
+    void flush();
+
+    /**
+     * Calls a function from a writer thread once every snippet queued before the call is written
+     * (at once if they already are), without blocking
+     * The function is never called if one of these snippets could not be written
+     */
+    void whenSaved(const std::function<void()>& callback) override;
+
+private:
+
+//===============// Private types //===============//
+
+    /**
+     * A snippet waiting to be encoded
+     */
+    struct RawSnippet {
+        cv::Mat snippet;
+        SnippetInfo info;
+        size_t sequence;
+    };
+
+    /**
+     * A snippet waiting to be written
+     */
+    struct EncodedSnippet {
+        std::vector<uchar> png;
+        SnippetInfo info;
+        size_t sequence;
+    };
+
+//===============// Attributes //===============//
+
+    // Maximum number of snippets written at once
+    const size_t batchSize;
+
+    // The manifest receiving the metadata (nullptr for .txt files)
+    SnippetManifest* manifest;
+
+    // Snippets waiting to be encoded
+    BoundedQueue<RawSnippet> rawQueue;
+
+    // Snippets waiting to be written
+    BoundedQueue<EncodedSnippet> encodedQueue;
+
+    // Threads encoding the snippets
+    std::vector<std::thread> encoders;
+
+    // Threads writing the files
+    std::vector<std::thread> writers;
+
+    // Number of snippets queued, number of the first ones all written,
+    // and the same once the functions waiting for them are done (seen by flush)
+    size_t nbQueued, nbContiguous, nbWritten;
+
+    // Sequence numbers of the snippets written before some of the previous ones (several encoders and writers)
+    std::set<size_t> writtenAhead;
+
+    // True once a snippet could not be written, and the lowest sequence number of such a snippet
+    bool failed;
+    size_t firstFailed;
+
+    // Number of waiting functions being called
+    size_t nbRunningCallbacks;
+
+    // Functions waiting for a number of written snippets
+    std::vector<std::pair<size_t, std::function<void()>>> savedCallbacks;
+
+    // Protects the counters and the callbacks
+    std::mutex countMutex;
+
+    // Notified when a batch is written
+    std::condition_variable batchWritten;
+
+//===============// Private methods //===============//
+
+    /**
+     * Loop of the encoding threads
+     */
+    void encodeLoop();
+
+    /**
+     * Loop of the writer thread
+     */
+    void writeLoop();
+
+    /**
+     * Writes the files of a batch of snippets
+     * @param failures filled with the sequence numbers of the snippets which could not be written
+     */
+    void writeBatch(const std::vector<EncodedSnippet>& batch, std::vector<size_t>& failures) const;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_ASYNCSNIPPETWRITER_HPP
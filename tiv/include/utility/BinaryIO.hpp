@@ -0,0 +1,86 @@
+#ifndef PROJET_OPENCV_CMAKE_BINARYIO_HPP
+#define PROJET_OPENCV_CMAKE_BINARYIO_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <ostream>
+
+#include "utility/SnippetInfo.hpp"
+
+/*
+ * Helpers to write and read the binary files of the output (pack, catalog, journal)
+ * Values are stored in the native byte order, strings with a 16 bits length
+ */
+namespace binaryio {
+
+    template <typename T>
+    inline void writeValue(std::ostream& out, T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    inline void writeString(std::ostream& out, const std::string& str) {
+        writeValue<uint16_t>(out, str.size());
+        out.write(str.data(), str.size());
+    }
+
+    /**
+     * Reads a value and moves the cursor after it
+     * @return false if there is not enough bytes before the end
+     */
+    template <typename T>
+    inline bool readValue(const unsigned char*& cursor, const unsigned char* end, T& value) {
+        if (end - cursor < (std::ptrdiff_t) sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    /**
+     * Reads a string and moves the cursor after it
+     * @return false if there is not enough bytes before the end
+     */
+    inline bool readString(const unsigned char*& cursor, const unsigned char* end, std::string& str) {
+        uint16_t length;
+        if (!readValue(cursor, end, length) || end - cursor < length) {
+            return false;
+        }
+        str.assign(reinterpret_cast<const char*>(cursor), length);
+        cursor += length;
+        return true;
+    }
+
+    inline void writeInfo(std::ostream& out, const SnippetInfo& info) {
+        writeValue<uint32_t>(out, info.row);
+        writeValue<uint32_t>(out, info.column);
+        writeString(out, info.path);
+        writeString(out, info.label);
+        writeString(out, info.size);
+        writeString(out, info.scripter);
+        writeString(out, info.page);
+    }
+
+    /**
+     * Reads the metadata of a snippet and moves the cursor after it
+     * @return false if there is not enough bytes before the end
+     */
+    inline bool readInfo(const unsigned char*& cursor, const unsigned char* end, SnippetInfo& info) {
+        uint32_t row, column;
+        if (!readValue(cursor, end, row) || !readValue(cursor, end, column) ||
+            !readString(cursor, end, info.path) || !readString(cursor, end, info.label) ||
+            !readString(cursor, end, info.size) || !readString(cursor, end, info.scripter) ||
+            !readString(cursor, end, info.page)) {
+            return false;
+        }
+        info.row = row;
+        info.column = column;
+        return true;
+    }
+
+}
+
+
+#endif //PROJET_OPENCV_CMAKE_BINARYIO_HPP
@@ -0,0 +1,111 @@
+#ifndef PROJET_OPENCV_CMAKE_BOUNDEDQUEUE_HPP
+#define PROJET_OPENCV_CMAKE_BOUNDEDQUEUE_HPP
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * A thread safe FIFO queue with a maximum capacity
+ * Used to connect the stages of a pipeline : producers block when it is full, consumers when it is empty
+ */
+template <typename T>
+class BoundedQueue {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the capacity
+     * @param capacity the maximum number of elements in the queue (at least 1)
+     */
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds an element, waiting for some room if the queue is full
+     * @return false if the queue was closed (the element is dropped)
+     */
+    bool push(T element) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || elements.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        elements.push(std::move(element));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Takes the first element, waiting for one if the queue is empty
+     * @return false if the queue is closed and empty (nothing will come anymore)
+     */
+    bool pop(T& element) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !elements.empty(); });
+        if (elements.empty()) {
+            return false;
+        }
+        element = std::move(elements.front());
+        elements.pop();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Takes the first element if there is one, without waiting
+     * @return false if the queue is empty
+     */
+    bool tryPop(T& element) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (elements.empty()) {
+            return false;
+        }
+        element = std::move(elements.front());
+        elements.pop();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue : no element can be pushed anymore, the remaining ones can still be popped
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+
+//===============// Attributes //===============//
+
+    // Maximum number of elements
+    const size_t capacity;
+
+    // True once close was called
+    bool closed;
+
+    // The elements waiting to be popped
+    std::queue<T> elements;
+
+    // Protects the elements and the closed flag
+    std::mutex mutex;
+
+    // Notified when an element is pushed or when the queue is closed
+    std::condition_variable notEmpty;
+
+    // Notified when an element is popped or when the queue is closed
+    std::condition_variable notFull;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_BOUNDEDQUEUE_HPP
@@ -10,6 +10,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <memory>
+
+#include <opencv2/core.hpp>
+
+#include "utility/SnippetPack.hpp"
+#include "utility/SnippetManifest.hpp"
+#include "utility/SnippetCatalog.hpp"
 
 /*
  * A Class used to generate all the filename for loading the Data
@@ -25,13 +33,32 @@ private:
     // A map containing the id of a form and the path to its image
     std::map<std::string, std::string> idToPath;
 
+    // Protects idToPath, which is filled by several workers
+    mutable std::mutex idMutex;
+
+    // Path of the pack file containing the output (empty if the output is in separate files)
+    std::string packPath;
+
+    // Reader of the pack file, opened the first time the output is read
+    mutable std::unique_ptr<SnippetPackReader> packReader;
+
+    // Path of the manifest containing the metadata of the output (empty if it is in .txt files)
+    std::string manifestPath;
+
+    // Content of the manifest, loaded the first time the output is read
+    mutable std::unique_ptr<SnippetManifestIndex> manifestIndex;
+
+    // Catalog of the output, used instead of listing the output directory (optional, not owned)
+    const SnippetCatalog* catalog;
+
 public:
 //===============// Constructor //===============//
 
     /**
      * Constructor with base path
+     * @param clearOutput delete the output of the previous runs (false to complete it)
      */
-    DataPathGenerator(const std::string& path, const std::string& outputPath);
+    DataPathGenerator(const std::string& path, const std::string& outputPath, bool clearOutput = true);
 
 
 
@@ -44,6 +71,7 @@ public:
 
     /**
      * Adds an element to the map idToPath
+     * Thread safe : can be called by several workers at the same time
      */
     void putPathWithId(const std::string& id, const std::string& path);
 
@@ -54,6 +82,34 @@ public:
      */
     std::pair<std::string, std::string> randomOutputPath() const;
 
+    /**
+     * Tells the generator that the output is in a pack file instead of separate files
+     * The pack must be closed before the output is read
+     */
+    void setPackPath(const std::string& path);
+
+    /**
+     * Tells the generator that the metadata of the output is in a manifest instead of .txt files
+     * The manifest must be flushed before the output is read
+     */
+    void setManifestPath(const std::string& path);
+
+    /**
+     * Tells the generator that all the snippets of the output are recorded in a catalog
+     * The snippets are then found without listing the output directory nor reading the whole index
+     * @param catalog the catalog (not owned), nullptr to list the output again
+     */
+    void setCatalog(const SnippetCatalog* catalog);
+
+    /**
+     * Reads a snippet of the output, from its files or from the pack
+     * @param name the name of the snippet (as given by randomOutputPath)
+     * @param snippet the picture of the snippet
+     * @param text the content of its .txt file (rebuilt from the manifest or the pack if needed)
+     * @return false if the snippet was not found
+     */
+    bool readOutput(const std::string& name, cv::Mat& snippet, std::string& text) const;
+
 private:
 
     /**
@@ -66,6 +122,18 @@ private:
      */
     int randomNumber(int lowerBound, int upperBound) const;
 
+    /**
+     * Gets the reader of the pack, opening it if needed
+     * @return nullptr if there is no pack or if it could not be read
+     */
+    const SnippetPackReader* getPackReader() const;
+
+    /**
+     * Gets the content of the manifest, loading it if needed
+     * @return nullptr if there is no manifest or if it could not be read
+     */
+    const SnippetManifestIndex* getManifestIndex() const;
+
 };
 
 
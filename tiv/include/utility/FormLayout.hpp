@@ -0,0 +1,66 @@
+#ifndef PROJET_OPENCV_CMAKE_FORMLAYOUT_HPP
+#define PROJET_OPENCV_CMAKE_FORMLAYOUT_HPP
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+/*
+ * The printed layout shared by the forms : the grid of snippets and the position of the reference icons
+ * Positions are in the pixels of the page the layout was measured on
+ * The offsets are in units of the grid vectors, their default values are the ones of our forms
+ */
+struct FormLayout {
+    // Size of the page the layout was measured on
+    cv::Size pageSize;
+
+    // Center of the top left snippet
+    cv::Point2f origin;
+
+    // Vectors from a snippet center to the center of the snippet on its right, and at its bottom
+    cv::Point2f pitchRight, pitchBottom;
+
+    // Number of rows and columns of snippets
+    int rows = 0, columns = 0;
+
+    // Side of a snippet box
+    float snippetSide = 0;
+
+    // Distance from the first snippet of a row to the reference icon, in grid vectors
+    double iconOffset = 1.14;
+
+    // Shift of the reference crop to the left, in right vectors
+    double referenceShift = 0.1;
+
+    // Shift of the form ID above the first reference, in bottom vectors
+    double idRowShift = 1.0;
+
+    /**
+     * A layout without grid only holds the offsets
+     */
+    inline bool hasGrid() const {
+        return rows > 0 && columns > 0 && snippetSide > 0;
+    }
+
+    /**
+     * Position of the center of a snippet
+     */
+    inline cv::Point2f snippetCenter(int row, int column) const {
+        return origin + column * pitchRight + row * pitchBottom;
+    }
+
+    /**
+     * Reads a layout written by save
+     * @return false if the file could not be read or has no grid
+     */
+    static bool load(const std::string& path, FormLayout& layout);
+
+    /**
+     * Writes the layout in a text file (one "key value..." line per field)
+     * @return false if the file could not be written
+     */
+    bool save(const std::string& path) const;
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_FORMLAYOUT_HPP
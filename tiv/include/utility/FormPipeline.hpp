@@ -0,0 +1,165 @@
+#ifndef PROJET_OPENCV_CMAKE_FORMPIPELINE_HPP
+#define PROJET_OPENCV_CMAKE_FORMPIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+#include "utility/BoundedQueue.hpp"
+#include "utility/SnippetExtractor.hpp"
+#include "utility/ImageRecognitionManager.hpp"
+#include "utility/DataPathGenerator.hpp"
+#include "utility/QualityChecker.hpp"
+#include "utility/RunJournal.hpp"
+#include "utility/RecognitionCache.hpp"
+#include "utility/ReferenceHashCache.hpp"
+
+/*
+ * A Class processing the forms through a pipeline of stages connected by bounded queues :
+ * decode -> binarize -> grid -> recognize -> extract -> encode
+ * Each stage has its own workers, so the I/O bound stages (decode, encode) overlap with the compute bound ones
+ * The capacity of the queues bounds the number of forms in memory
+ */
+class FormPipeline {
+public:
+//===============// Public types //===============//
+
+    /**
+     * Number of workers of each stage and capacity of the queues between them
+     */
+    struct Config {
+        unsigned int decodeWorkers = 1;
+        unsigned int binarizeWorkers = 1;
+        unsigned int gridWorkers = 1;
+        unsigned int recognizeWorkers = 1;
+        unsigned int extractWorkers = 1;
+        unsigned int encodeWorkers = 1;
+        size_t queueCapacity = 4;
+        SnippetExtractor::ExtractionMode extractionMode = SnippetExtractor::ExtractionMode::PerSnippet;
+        // Reduction of the page for the detection of the snippets (1, 2 or 4)
+        int detectionScale = 1;
+        SnippetExtractor::DetectionBackend detectionBackend = SnippetExtractor::DetectionBackend::Contours;
+        // Layout of the forms placed on each page instead of detecting the snippets (optional)
+        const FormLayout* layout = nullptr;
+        // Sink receiving the snippets in the encode stage (nullptr to save them synchronously)
+        SnippetSink* sink = nullptr;
+        // Catalog recording the snippets (optional)
+        SnippetCatalog* catalog = nullptr;
+        // Journal recording the completed forms (optional, needs the catalog)
+        RunJournal* journal = nullptr;
+        // Labels and sizes learned for each row of each page (optional)
+        RecognitionCache* recognitionCache = nullptr;
+        // Results of the recognition cached by a hash of the references (optional)
+        ReferenceHashCache* hashCache = nullptr;
+    };
+
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the shared managers
+     * The image recognition manager is only read, the generator and the checker are thread safe
+     */
+    FormPipeline(const Config& config, const ImageRecognitionManager& imgManager,
+                 DataPathGenerator& generator, QualityChecker& checker);
+
+//===============// Public methods //===============//
+
+    /**
+     * Processes all the forms and returns once the last one is saved
+     * @param pathToImages the paths of the images of the forms
+     */
+    void run(const std::vector<std::string>& pathToImages);
+
+    /**
+     * Gets a configuration spreading a number of threads among the stages
+     * Recognition (ORB) gets most of them, the others at least one
+     */
+    static Config defaultConfig(unsigned int nbThreads);
+
+private:
+
+//===============// Private types //===============//
+
+    /**
+     * A form going through the pipeline
+     */
+    struct FormJob {
+        std::string path;
+        cv::Mat image;
+        std::unique_ptr<SnippetExtractor> extractor;
+        std::string formIdText;
+        std::vector<cv::Mat> references;
+        std::vector<std::pair<std::string, std::string>> rowLabelSizes;
+        std::vector<std::vector<cv::Mat>> rowSnippets;
+    };
+
+    typedef BoundedQueue<std::unique_ptr<FormJob>> JobQueue;
+
+//===============// Attributes //===============//
+
+    Config config;
+
+    const ImageRecognitionManager& imgManager;
+
+    DataPathGenerator& generator;
+
+    QualityChecker& checker;
+
+    // Extractors of the finished forms, reused with their buffers by the next ones
+    mutable std::vector<std::unique_ptr<SnippetExtractor>> freeExtractors;
+
+    // Protects freeExtractors
+    mutable std::mutex freeMutex;
+
+//===============// Private methods //===============//
+
+    /**
+     * Gets an extractor for a new form, reusing a free one if possible
+     */
+    std::unique_ptr<SnippetExtractor> acquireExtractor() const;
+
+    /**
+     * Gives the extractor of a finished (or dropped) form back
+     */
+    void releaseExtractor(FormJob& job) const;
+
+//===============// Stages //===============//
+
+    /**
+     * Opens the image of the form
+     * @return false if the form must be dropped
+     */
+    bool decode(FormJob& job) const;
+
+    /**
+     * Binarizes the image
+     */
+    bool binarize(FormJob& job) const;
+
+    /**
+     * Finds the grid of snippets, the ID of the form and its references
+     */
+    bool grid(FormJob& job) const;
+
+    /**
+     * Recognizes the label and the size of each row
+     */
+    bool recognize(FormJob& job) const;
+
+    /**
+     * Crops the snippets of the recognized rows
+     */
+    bool extract(FormJob& job) const;
+
+    /**
+     * Saves the snippets
+     */
+    bool encode(FormJob& job) const;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_FORMPIPELINE_HPP
@@ -0,0 +1,104 @@
+#ifndef PROJET_OPENCV_CMAKE_HAMMINGMATCHER_HPP
+#define PROJET_OPENCV_CMAKE_HAMMINGMATCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*
+ * A brute-force matcher dedicated to the 256 bits descriptors computed by ORB
+ * The 2 nearest neighbors search and the Lowe's ratio test are done in a single pass,
+ * with a Hamming distance kernel chosen at runtime (AVX-512 VPOPCNTDQ, AVX2 or scalar)
+ * The images of an index are matched in the same query, but each one gets its own Lowe's test,
+ * as if a matcher was trained on each of them
+ */
+class HammingMatcher {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Default constructor
+     * Creates an empty index
+     */
+    HammingMatcher() = default;
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds the descriptors of one train image to the index
+     * The imgIdx of the matches found in it is the number of images added before
+     */
+    void add(const cv::Mat& descriptors);
+
+    /**
+     * Matches each query descriptor against each image of the index
+     * The 2 nearest neighbors are searched within each image, so a query descriptor can match several images
+     * @param ratio the Lowe's ratio, a match is kept if best distance < ratio * second best distance
+     * @param good_matches filled with the kept matches, by query then by image (trainIdx is relative to the image imgIdx)
+     */
+    void ratioMatch(const cv::Mat& queryDescriptors, float ratio, std::vector<cv::DMatch>& good_matches) const;
+
+    /**
+     * Matches each query descriptor against the descriptors of some images of the index only
+     * Same as above, as if the index only held these images
+     * @param images the indexes of the images to search, in increasing order
+     */
+    void ratioMatch(const cv::Mat& queryDescriptors, const std::vector<int>& images, float ratio,
+                    std::vector<cv::DMatch>& good_matches) const;
+
+    /**
+     * Matches each query descriptor against the train descriptors, without building an index
+     * Same as above, with imgIdx always 0
+     */
+    static void ratioMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                           float ratio, std::vector<cv::DMatch>& good_matches);
+
+    /**
+     * Number of images added to the index
+     */
+    inline size_t getNumberImages() const {
+        return firstOfImage.size();
+    }
+
+    /**
+     * Name of the distance kernel used on this machine
+     */
+    static const char* getKernelName();
+
+private:
+
+//===============// Private constants //===============//
+
+    // Size of an ORB descriptor in bytes
+    static const int descriptorBytes;
+
+//===============// Attributes //===============//
+
+    // All the train descriptors, stored contiguously (descriptorBytes bytes per descriptor)
+    std::vector<uchar> descriptors;
+
+    // Index of the first descriptor of each image
+    std::vector<int> firstOfImage;
+
+//===============// Private methods //===============//
+
+    /**
+     * Checks that the descriptors are 32 bytes ORB descriptors and gives their bytes
+     * They are read in place, or copied to the buffer if the matrix is not contiguous
+     * @return nullptr if there is no descriptor
+     */
+    static const uchar* getDescriptors(const cv::Mat& src, std::vector<uchar>& buffer);
+
+    /**
+     * Index of the descriptor after the last one of an image
+     */
+    inline int imageEnd(int image) const {
+        return image + 1 < (int) firstOfImage.size() ? firstOfImage[image + 1] : (int) (descriptors.size() / descriptorBytes);
+    }
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_HAMMINGMATCHER_HPP
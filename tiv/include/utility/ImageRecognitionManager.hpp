@@ -6,18 +6,47 @@
 #define PROJET_OPENCV_CMAKE_IMAGERECOGNITIONMANAGER_HPP
 
 #include <string>
+#include <vector>
 #include <map>
 
+#include <opencv2/core.hpp>
+
+#include "utility/HammingMatcher.hpp"
+#include "utility/SizeClassifier.hpp"
+
 /*
  * A Class used to determine the label and the size of an image
  */
 class ImageRecognitionManager {
 public:
+//===============// Public types //===============//
+
+    /**
+     * Keypoints and descriptors computed by ORB on a single image
+     */
+    struct Features {
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        // Global descriptor used to rank the labels (empty without cascade)
+        cv::Mat prefilter;
+        // Text line of the size (empty without fast size detection)
+        SizeClassifier::Patch sizePatch;
+    };
+
+    /**
+     * Cheap global descriptor ranking the labels before ORB
+     * None : every label is matched
+     * Correlation : normalized correlation of 32x32 thumbnails
+     * EdgeHistogram : histograms of the gradient orientations on a 4x4 grid of the 32x32 thumbnail
+     */
+    enum class Prefilter {None, Correlation, EdgeHistogram};
+
 //===============// Constructor //===============//
 
     /**
      * Default constructor
      * Builds the base of the 42 matrix (loads each image from the base)
+     * and computes the ORB features of each of them once
      */
     ImageRecognitionManager();
 
@@ -31,6 +60,33 @@ public:
      */
     std::pair<std::string, std::string>  imageRecognitionAlgorithm(const cv::Mat& processImg) const;
 
+    /**
+     * Same as above, but on the already computed features of the image to process
+     * The features are matched against every reference without being computed again
+     */
+    std::pair<std::string, std::string>  imageRecognitionAlgorithm(const Features& processFeatures) const;
+
+    /**
+     * Computes the ORB features of an image to process, so that they can be reused
+     * @return the keypoints and descriptors of the image
+     */
+    Features computeFeatures(const cv::Mat& processImg) const;
+
+    /**
+     * Only match the ORB features against the labels ranked first by a cheap global descriptor
+     * Must be called before the recognition starts
+     * @param topK number of labels matched (every label if 0 or more than the number of labels)
+     */
+    void setCascade(Prefilter prefilter, int topK);
+
+    /**
+     * Recognize the size with the size classifier instead of ORB
+     * The classifier is built from the size images when it is enabled
+     * Must be called before the recognition starts
+     * @return false if the classifier is disabled (or could not be built)
+     */
+    bool setFastSizeDetection(bool enabled);
+
     /**
      * Getter for the labels
      */
@@ -48,6 +104,9 @@ private:
     // Names of all possible sizes
     static const std::vector<std::string> sizes;
 
+    // Ratio used by the Lowe's test to select the best matches
+    static const float loweRatio;
+
 //===============// Attributes //===============//
 
     // Map associating the name of a label with its matrix
@@ -56,6 +115,26 @@ private:
     // Map associating the name of a size with its matrix
     std::map<std::string, cv::Mat> baseSizes;
 
+    // Map associating the name of a label with its precomputed ORB features
+    std::map<std::string, Features> featuresLabels;
+
+    // Map associating the name of a size with its precomputed ORB features
+    std::map<std::string, Features> featuresSizes;
+
+    // Matcher index holding the descriptors of all the labels (one train image per label)
+    HammingMatcher labelMatcher;
+
+    // Global descriptor of the cascade and its number of candidates
+    Prefilter prefilter;
+    int topK;
+
+    // Global descriptor of each label, in the order of labels
+    std::vector<cv::Mat> prefilterLabels;
+
+    // Classifier of the size words, used instead of ORB if fastSize is set
+    SizeClassifier sizeClassifier;
+    bool fastSize;
+
 //===============// Private methods //===============//
 
     /**
@@ -64,25 +143,47 @@ private:
     void initImg(const std::string& img);
 
     /**
-     * Gets the ratio of good match among all matches of keypoints detection and the rotation between the process and reference image
-     * @return A pair containing the ratio and the rotation
+     * Trains the matcher index with the descriptors of every label
+     */
+    void initLabelMatcher();
+
+    /**
+     * Computes the global descriptor of an image (a unit vector, the score of two images is their dot product)
      */
-    std::pair<double, double> getRatioRotation(const cv::Mat& processImg, const cv::Mat& referenceImg, bool isLabel) const;
+    static cv::Mat computePrefilter(const cv::Mat& img, Prefilter prefilter);
 
     /**
-     * Detects and computes the features and descriptors of the reference image and the one to process - using ORB algorithm
+     * Ranks the labels by the score of their global descriptor with the one of the image to process
+     * @return the indexes of the topK best labels, in increasing order
+     */
+    std::vector<int> getCandidateLabels(const Features& processFeatures) const;
+
+    /**
+     * Matches the image to process against the index of all labels (or of the candidates of the cascade) with a single knn query
+     * @param matchesPerLabel filled with the good matches (after Lowe's test) found for each label, in the order of labels
+     */
+    void getLabelMatches(const Features& processFeatures, std::vector<std::vector<cv::DMatch>>& matchesPerLabel) const;
+
+    /**
+     * Gets the rotation between a reference and the processed image from the homography of their good matches
+     * @param isSceneQuery true if the processed image descriptors were the query of the matches
+     * @return The absolute rotation in degrees (90 if it could not be computed)
+     */
+    double getRotation(const std::vector<cv::DMatch>& good_matches,
+                       const std::vector<cv::KeyPoint>& keypoints_object,
+                       const std::vector<cv::KeyPoint>& keypoints_scene,
+                       bool isSceneQuery) const;
+
+    /**
+     * Gets the ratio of good match among all matches of keypoints detection and the rotation between the process and reference image
+     * @return A pair containing the ratio and the rotation
      */
-    void ORBFeaturesDetection(const cv::Mat& referenceImg,
-                              const cv::Mat& processImg,
-                              std::vector<cv::KeyPoint>& keypoints_object,
-                              std::vector<cv::KeyPoint>& keypoints_scene,
-                              cv::Mat& descriptors_object,
-                              cv::Mat& descriptors_scene) const;
+    std::pair<double, double> getRatioRotation(const Features& processFeatures, const Features& reference, bool isLabel) const;
 
     /**
-     * Uses the Lowe's test filter to select the best matches
+     * Detects and computes the features and descriptors of an image - using ORB algorithm
      */
-    void loweTestFilter(const std::vector<std::vector<cv::DMatch>>& knn_matches, std::vector<cv::DMatch>& good_matches) const;
+    void ORBFeaturesDetection(const cv::Mat& img, Features& features) const;
 
 };
 
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <map>
+#include <mutex>
 
 #include "utility/DataPathGenerator.hpp"
 
@@ -22,6 +23,7 @@ public:
 
     /**
      * Increments the count of the already seen or not label in parameter
+     * Thread safe : can be called by several workers at the same time
      */
     void putLabel(const std::string& label);
 
@@ -80,6 +82,9 @@ private:
     // A map associating a label name with its recall result
     std::map<std::string, double> recall;
 
+    // Protects the label counts, which are filled by several workers
+    mutable std::mutex countMutex;
+
 };
 
 
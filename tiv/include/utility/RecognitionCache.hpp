@@ -0,0 +1,101 @@
+#ifndef PROJET_OPENCV_CMAKE_RECOGNITIONCACHE_HPP
+#define PROJET_OPENCV_CMAKE_RECOGNITIONCACHE_HPP
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+/*
+ * The icons of a given page are the same for every scripter : the label and the size of each row
+ * are learned from the first pages, then the later pages are only verified against a thumbnail of the reference
+ * Keyed by the page id (digits 2 to 5 of the form id) and the row
+ */
+class RecognitionCache {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor
+     * @param agreements number of pages that must agree on the label and size of a row before it is trusted
+     */
+    explicit RecognitionCache(int agreements = 3);
+
+//===============// Public methods //===============//
+
+    /**
+     * Gets the label and size of a row if they are trusted and the reference looks like the learned one
+     * Thread safe
+     * @param reference the crop of the reference of the row
+     * @param labelSize filled with the learned label and size
+     * @return false if the row must be recognized
+     */
+    bool lookup(const std::string& page, int row, const cv::Mat& reference,
+                std::pair<std::string, std::string>& labelSize);
+
+    /**
+     * Records the label and size recognized on a row
+     * Thread safe
+     * @param reference the crop of the reference of the row
+     * @param labelSize the recognized label and size (ignored if there is no label)
+     */
+    void record(const std::string& page, int row, const cv::Mat& reference,
+                const std::pair<std::string, std::string>& labelSize);
+
+    /**
+     * Getter for the number of rows verified without being recognized
+     */
+    inline size_t getNumberHits() const {
+        return hits;
+    }
+
+private:
+
+//===============// Private types //===============//
+
+    /**
+     * What is known about a row of a page
+     */
+    struct Entry {
+        std::pair<std::string, std::string> labelSize;
+        int agreements = 0;
+        // Normalized thumbnail of the reference, once trusted
+        cv::Mat thumbnail;
+    };
+
+//===============// Private constants //===============//
+
+    // Side of the thumbnails
+    static const int thumbnailSide;
+
+    // Minimal correlation between a reference and the learned thumbnail
+    static const double minCorrelation;
+
+//===============// Attributes //===============//
+
+    // Pages needed to trust a row
+    int agreements;
+
+    // Rows of each page
+    std::map<std::pair<std::string, int>, Entry> entries;
+
+    // Protects the entries
+    std::mutex mutex;
+
+    // Rows verified without being recognized
+    std::atomic<size_t> hits;
+
+//===============// Private methods //===============//
+
+    /**
+     * Reduces a reference to a thumbnail of zero mean and unit norm
+     */
+    static cv::Mat getThumbnail(const cv::Mat& reference);
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_RECOGNITIONCACHE_HPP
@@ -0,0 +1,109 @@
+#ifndef PROJET_OPENCV_CMAKE_REFERENCEHASHCACHE_HPP
+#define PROJET_OPENCV_CMAKE_REFERENCEHASHCACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+/*
+ * The label and size recognized on a reference, cached by a perceptual hash (dHash) of the crop
+ * Near-identical references (a few different bits) give the cached result instead of being recognized again
+ * The hash is split in radius + 1 chunks : two hashes within the radius share at least one chunk,
+ * so only the entries sharing a chunk are compared
+ */
+class ReferenceHashCache {
+public:
+//===============// Public constants //===============//
+
+    // Confidence of a hit under which the reference is recognized again (more than 3 different bits)
+    static const double minConfidence;
+
+//===============// Constructor //===============//
+
+    /**
+     * Constructor
+     * @param radius maximal number of different bits between two hashes of the same reference
+     */
+    explicit ReferenceHashCache(int radius = 4);
+
+//===============// Public methods //===============//
+
+    /**
+     * Computes the 64 bits difference hash of a reference
+     * (the crop is reduced to 9x8 and each bit tells if a pixel is darker than its right neighbor)
+     */
+    static uint64_t getHash(const cv::Mat& reference);
+
+    /**
+     * Finds the closest result within the radius
+     * Thread safe
+     * @param labelSize filled with the cached label and size
+     * @param confidence filled with the ratio of identical bits between the two hashes
+     * @return false on a miss
+     */
+    bool lookup(uint64_t hash, std::pair<std::string, std::string>& labelSize, double& confidence);
+
+    /**
+     * Records the result of the recognition of a reference
+     * A reference without label, or already recorded within the radius, is not recorded
+     * Thread safe
+     */
+    void record(uint64_t hash, const std::pair<std::string, std::string>& labelSize);
+
+    /**
+     * Getters for the number of hits and misses
+     */
+    inline size_t getNumberHits() const {
+        return hits;
+    }
+
+    inline size_t getNumberMisses() const {
+        return misses;
+    }
+
+private:
+
+//===============// Private types //===============//
+
+    struct Entry {
+        uint64_t hash;
+        std::pair<std::string, std::string> labelSize;
+    };
+
+//===============// Attributes //===============//
+
+    int radius;
+
+    // Bits of each chunk : chunk i is (hash >> shifts[i]) & masks[i]
+    std::vector<int> shifts;
+    std::vector<uint64_t> masks;
+
+    std::vector<Entry> entries;
+
+    // Indexes of the entries for each value of each chunk
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> chunkIndex;
+
+    // Protects the entries and the index
+    std::mutex mutex;
+
+    std::atomic<size_t> hits, misses;
+
+//===============// Private methods //===============//
+
+    /**
+     * Finds the closest entry within the radius (the mutex must be locked)
+     * @param distance filled with the number of different bits
+     * @return the index of the entry, or -1 if there is none
+     */
+    int findNearest(uint64_t hash, int& distance) const;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_REFERENCEHASHCACHE_HPP
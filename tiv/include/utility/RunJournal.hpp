@@ -0,0 +1,137 @@
+#ifndef PROJET_OPENCV_CMAKE_RUNJOURNAL_HPP
+#define PROJET_OPENCV_CMAKE_RUNJOURNAL_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <mutex>
+
+#include "utility/SnippetInfo.hpp"
+
+/*
+ * A journal of the forms completed by the previous runs, used to only process the new or modified ones
+ * Each completed form is appended as soon as it is done, with the hash of its image and the snippets it produced,
+ * so a run stopped in the middle resumes after its last completed form
+ * Layout of the file :
+ *  - "TIVJRNL1"
+ *  - for each completed form : the pipeline version, the path of the image (16 bits length + characters),
+ *    the hash of the image (64 bits), the number of snippets (32 bits), the snippets, then "DONE"
+ * A record cut by a crash is ignored
+ * The last record of each form is kept whatever its version, so that the outputs it lists can be removed
+ */
+class RunJournal {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the path of the journal and the version of the pipeline
+     * The journal is compacted : only the last record of each form is kept
+     */
+    RunJournal(const std::string& path, const std::string& version);
+
+//===============// Public methods //===============//
+
+    /**
+     * Hashes the image of a form and checks if it was already completed with the same content and version
+     * Thread safe : can be called by several workers at the same time
+     * @param input the path of the image
+     * @param snippets filled with the snippets produced by the form if it was completed
+     * @return true if the form can be skipped
+     */
+    bool check(const std::string& input, std::vector<SnippetInfo>& snippets);
+
+    /**
+     * Records a completed form, with the hash computed by check
+     * Thread safe : can be called by several workers at the same time
+     * @param input the path of the image
+     * @param snippets the snippets produced by the form
+     */
+    void markDone(const std::string& input, const std::vector<SnippetInfo>& snippets);
+
+    /**
+     * Gets the snippets of the last record of a form which cannot be skipped
+     * Call it after check returned false : the outputs of the previous run must be removed before processing it again
+     * @param snippets filled with the snippets of the record
+     * @return false if the form has no record
+     */
+    bool getOutdated(const std::string& input, std::vector<SnippetInfo>& snippets) const;
+
+    /**
+     * Forgets the forms which are not inputs anymore, and compacts the journal
+     * @param inputs the paths of the images of this run
+     * @param removed filled with the snippets of the forgotten forms
+     */
+    void prune(const std::vector<std::string>& inputs, std::vector<SnippetInfo>& removed);
+
+    /**
+     * Number of forms completed by the previous runs
+     */
+    size_t getNumberDone() const;
+
+    /**
+     * Hashes the content of a file (64 bits FNV-1a)
+     * @param ok set to false if the file could not be read
+     */
+    static uint64_t hashFile(const std::string& path, bool& ok);
+
+//===============// Public constants //===============//
+
+    // Version of the extraction : to be changed when the output of a form changes
+    static const std::string pipelineVersion;
+
+private:
+
+//===============// Private types //===============//
+
+    /**
+     * A form completed by a previous run
+     */
+    struct Entry {
+        std::string version;
+        uint64_t hash;
+        std::vector<SnippetInfo> snippets;
+    };
+
+//===============// Attributes //===============//
+
+    // Path of the journal
+    std::string path;
+
+    // Version of the pipeline of this run
+    std::string version;
+
+    // Last record of each form completed by the previous runs (of any version)
+    std::map<std::string, Entry> done;
+
+    // Hash of the forms checked by this run
+    std::map<std::string, uint64_t> hashes;
+
+    // The journal file, opened for appending
+    std::ofstream file;
+
+    // Protects all the attributes
+    mutable std::mutex mutex;
+
+//===============// Private methods //===============//
+
+    /**
+     * Reads the records of the journal
+     */
+    void load();
+
+    /**
+     * Rewrites the journal with the records in memory, then opens it for appending
+     */
+    void compact();
+
+    /**
+     * Serializes the record of a completed form
+     */
+    void writeRecord(std::ostream& out, const std::string& input, const Entry& entry) const;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_RUNJOURNAL_HPP
@@ -0,0 +1,75 @@
+#ifndef PROJET_OPENCV_CMAKE_SIZECLASSIFIER_HPP
+#define PROJET_OPENCV_CMAKE_SIZECLASSIFIER_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*
+ * A Class recognizing the size word printed under the icon of a reference, without ORB
+ * The lowest text line of the reference is binarized, reduced to a fixed size patch
+ * and compared to the patches of the size images by normalized correlation
+ * A reference without text line, or too different from every size, has no size
+ */
+class SizeClassifier {
+public:
+//===============// Public types //===============//
+
+    /**
+     * The text line of a reference, reduced to a zero mean and unit norm patch
+     */
+    struct Patch {
+        cv::Mat pixels;
+        // Width of the text line divided by its height
+        double aspect = 0;
+
+        inline bool empty() const {
+            return pixels.empty();
+        }
+    };
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds a size to recognize
+     * @param img an image of the size word, at the bottom of the image like on the references
+     * @return false if no text line is found on the image
+     */
+    bool addSize(const std::string& size, const cv::Mat& img);
+
+    /**
+     * Extracts the lowest text line of an image
+     * @return an empty patch if there is no text line
+     */
+    static Patch computePatch(const cv::Mat& img);
+
+    /**
+     * Finds the size written on a patch
+     * @return the size, or an empty string if there is none
+     */
+    std::string classify(const Patch& patch) const;
+
+private:
+
+//===============// Private constants //===============//
+
+    // Size of the patches
+    static const cv::Size patchSize;
+
+    // Minimal correlation between a patch and the patch of its size
+    static const double minCorrelation;
+
+    // Maximal ratio between the aspects of a patch and of the patch of its size
+    static const double maxAspectRatio;
+
+//===============// Attributes //===============//
+
+    // Names and patches of the sizes
+    std::vector<std::string> sizes;
+    std::vector<Patch> patches;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SIZECLASSIFIER_HPP
@@ -0,0 +1,106 @@
+#ifndef PROJET_OPENCV_CMAKE_SNIPPETCATALOG_HPP
+#define PROJET_OPENCV_CMAKE_SNIPPETCATALOG_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <mutex>
+
+#include "utility/SnippetInfo.hpp"
+
+/*
+ * An in-memory catalog of the produced snippets, filled by the extractors as they save them
+ * Snippets can be looked up by form id (scripter + page), label, position or name without scanning the output
+ * It is not persisted : an incremental run fills it again from the journal
+ */
+class SnippetCatalog {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Default constructor
+     * Creates an empty catalog
+     */
+    SnippetCatalog() = default;
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds a produced snippet
+     * Thread safe : can be called by several workers at the same time
+     */
+    void add(const SnippetInfo& info);
+
+    /**
+     * Total number of snippets
+     */
+    size_t size() const;
+
+    /**
+     * Number of snippets of a form
+     * @param formId the scripter number followed by the page number
+     */
+    size_t countForm(const std::string& formId) const;
+
+    /**
+     * Gets a snippet of a form
+     * @param index the index of the snippet among the ones of the form (in [0, countForm))
+     * @return false if there is no such snippet
+     */
+    bool getFormSnippet(const std::string& formId, size_t index, SnippetInfo& info) const;
+
+    /**
+     * Gets all the snippets of a form
+     */
+    std::vector<SnippetInfo> getForm(const std::string& formId) const;
+
+    /**
+     * Gets the snippet at a position of a form
+     * @return false if there is no such snippet
+     */
+    bool find(const std::string& formId, unsigned int row, unsigned int column, SnippetInfo& info) const;
+
+    /**
+     * Gets a snippet from its name (its file name, without directory nor extension)
+     * @return false if there is no such snippet
+     */
+    bool findByName(const std::string& name, SnippetInfo& info) const;
+
+    /**
+     * Gets all the snippets with a label
+     */
+    std::vector<SnippetInfo> getLabel(const std::string& label) const;
+
+    /**
+     * Gets the form id of a snippet (scripter + page)
+     */
+    static std::string getFormId(const SnippetInfo& info);
+
+private:
+
+//===============// Attributes //===============//
+
+    // All the snippets, in the order they were added
+    std::vector<SnippetInfo> infos;
+
+    // Indexes of the snippets of each form
+    std::unordered_map<std::string, std::vector<size_t>> byForm;
+
+    // Indexes of the snippets of each label
+    std::unordered_map<std::string, std::vector<size_t>> byLabel;
+
+    // Index of the snippet at each position (form, row, column)
+    std::map<std::tuple<std::string, unsigned int, unsigned int>, size_t> byPosition;
+
+    // Index of the snippet of each name
+    std::unordered_map<std::string, size_t> byName;
+
+    // Protects all the attributes
+    mutable std::mutex mutex;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SNIPPETCATALOG_HPP
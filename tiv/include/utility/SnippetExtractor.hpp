@@ -6,8 +6,16 @@
 #define PROJET_OPENCV_CMAKE_SNIPPETEXTRACTOR_HPP
 
 
+#include <vector>
+#include <utility>
+#include <atomic>
+
 #include <opencv2/core/mat.hpp>
 
+#include "utility/SnippetSink.hpp"
+#include "utility/SnippetCatalog.hpp"
+#include "utility/FormLayout.hpp"
+
 /**
  * Class used to extract snippets from images (OpenCV Mat)
  * Snippets are sub-image extracted from the main images
@@ -15,13 +23,61 @@
 class SnippetExtractor {
 public:
 
+    /**
+     * How the snippets are straightened before being cropped
+     * PerSnippet : each snippet is deskewed from its own rotated rect
+     * PageDeskew : the page is rotated once using the grid vectors, snippets are views on it
+     */
+    enum class ExtractionMode {
+        PerSnippet,
+        PageDeskew
+    };
+
+    /**
+     * How the snippet boxes are found on the binarized page
+     * Contours : every external contour is traced, then the square ones of the snippet size are kept
+     * ConnectedComponents : the boxes come with the labeling of the page, only the contours of the snippets are traced
+     */
+    enum class DetectionBackend {
+        Contours,
+        ConnectedComponents
+    };
+
     /**
      * Default constructor
-     * It only creates the directory ./output/
+     * It only creates the directory ./output/ (for the first extractor)
+     * An extractor can be used for several pages : its buffers are kept from one page to the next
      */
     SnippetExtractor();
 
 
+    /**
+     * Destructor, adding the allocations of the last page to the total
+     */
+    ~SnippetExtractor();
+
+
+    /**
+     * Forget the current page, keeping the buffers for the next one
+     * Called by setImage and binarize
+     */
+    void reset();
+
+
+    /**
+     * Number of times a buffer kept between the pages had to be allocated or moved
+     * It should not change anymore once a few pages of the same layout were processed
+     * (the page given to setImage and the buffers of the filters, kept by each thread, are not counted)
+     */
+    size_t getNumberAllocations() const;
+
+
+    /**
+     * Number of allocations of all the extractors, counted when they start a page and when they are destroyed
+     */
+    static size_t getTotalAllocations();
+
+
     /**
      * Set the image that will be used for the future extractions
      * @param image a const reference to the OpenCV image
@@ -29,6 +85,99 @@ public:
     bool setImage(const cv::Mat& image);
 
 
+    /**
+     * Set the image that will be used for the future extractions, taking it without copy
+     * @param image the OpenCV image, left empty (use getImage to read it again)
+     */
+    bool setImage(cv::Mat&& image);
+
+
+    /**
+     * Get the image given to setImage (or binarize)
+     * @return the unchanged image
+     */
+    const cv::Mat& getImage() const;
+
+
+    /**
+     * First part of setImage : copy the image and binarize it
+     * The page is processed by bands of rows, in parallel : each band goes through the gray scale conversion,
+     * the blur and the threshold while it is in the cache
+     * @param image a const reference to the OpenCV image
+     */
+    void binarize(const cv::Mat& image);
+
+
+    /**
+     * First part of setImage, taking the image without copy
+     * @param image the OpenCV image, left empty (use getImage to read it again)
+     */
+    void binarize(cv::Mat&& image);
+
+
+    /**
+     * Second part of setImage : find the snippets and build their grid on the binarized image
+     * @return false if not enough snippets were found
+     */
+    bool detectGrid();
+
+
+    /**
+     * Set the extraction mode used by the future calls to setImage
+     * PageDeskew is faster, but expects a uniform skew on the whole page
+     * @param mode the extraction mode (PerSnippet by default)
+     */
+    void setExtractionMode(ExtractionMode mode);
+
+
+    /**
+     * Set the backend finding the snippets in the future calls to setImage
+     * @param backend the detection backend (Contours by default)
+     */
+    void setDetectionBackend(DetectionBackend backend);
+
+
+    /**
+     * Set the layout of the forms given to the future calls to setImage
+     * The layout is placed on each page from a reduced copy, and the snippets are computed from it,
+     * instead of being found by the analysis of the contours (which is still done if the layout can not be placed)
+     * @param layout the layout (not owned), nullptr to always detect the snippets
+     */
+    void setLayout(const FormLayout* layout);
+
+
+    /**
+     * Describe the layout of the grid found on the current page
+     * @param layout filled with the grid and the offsets of the current layout
+     * @return false if the grid is too small to measure the layout
+     */
+    bool getLayout(FormLayout& layout) const;
+
+
+    /**
+     * Set the reduction of the page on which the snippets are detected by the future calls to setImage
+     * The snippets are still cropped from the unchanged image, the detection is about scale² times faster
+     * @param scale 1 to detect on the whole page (by default), 2 or 4 for a page reduced as much in each direction
+     */
+    void setDetectionScale(int scale);
+
+
+    /**
+     * Set the sink receiving the future extracted snippets
+     * For example an AsyncSnippetWriter to save them in the background,
+     * or a CallbackSnippetSink to use them directly in memory
+     * @param sink the sink (not owned), nullptr to save them synchronously in the output directory
+     */
+    void setSink(SnippetSink* sink);
+
+
+    /**
+     * Set the catalog in which the future extracted snippets are recorded
+     * @param catalog the catalog (not owned), nullptr to not record them
+     */
+    void setCatalog(SnippetCatalog* catalog);
+
+
     /**
      * Extract a row of snippets from an image
      * @param the number of the row (starting at 0)
@@ -42,6 +191,27 @@ public:
                     const std::string& scripterNum, const std::string pageNum);
 
 
+    /**
+     * First part of extractRow : crop the snippets of a row, without saving them
+     * @param row the number of the row (starting at 0)
+     * @param snippets filled with the snippets of the row, in the order of the columns
+     */
+    void cropRow(uint row, std::vector<cv::Mat>& snippets);
+
+
+    /**
+     * Second part of extractRow : save the cropped snippets of a row
+     * @param row the number of the row (starting at 0)
+     * @param snippets the snippets given by cropRow
+     * @param icondID the icon name for the current row
+     * @param iconSize the icon size
+     * @param scripterNum the scripter number as a string
+     * @param pageNum the number of the page loaded for the referred scripter
+     */
+    void saveRow(uint row, const std::vector<cv::Mat>& snippets, const std::string& iconName, const std::string iconSize,
+                 const std::string& scripterNum, const std::string pageNum);
+
+
     /**
      * Get the number of rows found
      * @return the rows number as a number
@@ -62,6 +232,7 @@ public:
 
     /**
      * Extract the first column of a given image
+     * In PageDeskew mode, the references are views on the deskewed page instead of the given image
      * @param image of the file
      * @param image to process
      * @return the snippets on the first column
@@ -70,6 +241,7 @@ public:
 
     /**
      * Extract the up left ID of a given form
+     * In PageDeskew mode, the ID is a view on the deskewed page instead of the given image
      * @param image of the file
      * @param image to process
      * @return the cropped image with the ID
@@ -77,14 +249,92 @@ public:
     void getFormID(const cv::Mat &image, cv::Mat &references) const;
 
 private:
+//===============// Private types //===============//
+
+    // Position and capacity of the buffers kept between the pages
+    typedef std::vector<std::pair<const void*, size_t> > BufferList;
+
 //===============// Private methods //===============//
 
+    /**
+     * List the buffers kept between the pages
+     */
+    void listBuffers(BufferList& buffers) const;
+
+    /**
+     * Count the buffers allocated or moved between two lists
+     */
+    static size_t countAllocations(const BufferList& before, const BufferList& after);
+
+    /**
+     * Binarize the unchanged image (or its reduction) into the current image
+     * @param scale the reduction of the page
+     */
+    void binarizeUnchangedImage(int scale);
+
+    /**
+     * Place the layout on the current image and compute the snippets from it
+     * @return false if the layout could not be placed
+     */
+    bool registerLayout();
+
+    /**
+     * Get the layout giving the offsets of the reference icons
+     * @return the given layout, or the default one
+     */
+    const FormLayout& layout() const;
+
+    /**
+     * Binarize a band of rows of the image
+     * The filters are applied on the band and its neighbor rows only, the result is the same as on the whole page
+     * @param image the colored image
+     * @param rows the rows of the band
+     */
+    void binarizeBand(const cv::Mat& image, const cv::Range& rows);
+
     /**
      * Get the snippet region for the current snippet
      * @return the snippet region as an OpenCV rotated rect
      */
     cv::RotatedRect snippetRect() const;
 
+    /**
+     * Deskew a snippet of the unchanged image
+     * Only the pixels of the rotated rect (plus a small border) are resampled,
+     * the result is the same as rotating the whole page then cropping it
+     * (with OpenCV 5, up to 1 grey level)
+     * @param rect the snippet region
+     * @param cropped the straightened snippet
+     */
+    void deskewSnippet(const cv::RotatedRect& rect, cv::Mat& cropped);
+
+    /**
+     * Rotate the whole unchanged image once, using the angle of the grid vectors
+     */
+    void deskewPage();
+
+    /**
+     * Get the position of a point of the unchanged image on the deskewed page
+     * @param point a const reference to the point
+     * @return the point on the deskewed page
+     */
+    cv::Point2f toDeskewed(const cv::Point2f& point) const;
+
+    /**
+     * Get the current snippet as a view on the deskewed page (without copy nor resampling)
+     * @return the snippet without its margin
+     */
+    cv::Mat deskewedSnippet() const;
+
+    /**
+     * Crop a square region of the image used for the references
+     * @param image the image to crop (the deskewed page in PageDeskew mode)
+     * @param center the center of the region on the unchanged image
+     * @param width the size of the square region
+     * @return the region as a view on the image
+     */
+    cv::Mat cropSquare(const cv::Mat& image, const cv::Point& center, double width) const;
+
 
     /**
      * Generate a filename to save a snippet
@@ -120,6 +370,27 @@ private:
      */
     void findSnippetContours();
 
+    /**
+     * Find the snippets with the connected components of the current image (ConnectedComponents backend)
+     */
+    void findSnippetComponents();
+
+    /**
+     * Estimate the area of a snippet from the areas of the shapes found on the page
+     */
+    void estimateSnippetArea();
+
+    /**
+     * Bring the snippets found on the reduced page to the coordinates of the unchanged image
+     */
+    void scaleDetection();
+
+    /**
+     * Build the spatial hash of the bounding boxes
+     * The page is divided in square buckets of the size of a snippet, each one listing the boxes overlapping it
+     */
+    void buildSpatialHash();
+
     /**
      * Find the centers for the current contours
      */
@@ -141,6 +412,18 @@ private:
     void buildIndexGrid();
 
 
+    /**
+     * Empty the grid of indexes, keeping its rows aside
+     */
+    void clearIndexGrid();
+
+    /**
+     * Add a row to the grid of indexes, reusing a row kept aside if possible
+     * @param firstIndex the index of the first snippet of the row
+     */
+    void addGridRow(int firstIndex);
+
+
     /**
      * Get the distance between two points
      * @param p1 a const reference to the first point
@@ -180,6 +463,27 @@ private:
     // Error factor allowed when checking size and area
     static const double errorFactor;
 
+    // Sink used when none is given
+    static DiskSnippetSink defaultSink;
+
+    // Border kept around a snippet for the bilinear interpolation of getRectSubPix
+    static const int subPixBorder;
+
+    // Border kept around a snippet for the cubic interpolation of warpAffine (OpenCV 5)
+    static const int cubicBorder;
+
+    // Number of rows of the bands binarized at once
+    static const int bandRows;
+
+    // Reduction of the page on which a layout is placed
+    static const int registrationScale;
+
+    // Part of the cells of a layout that must be matched with a candidate (and fit the transform) to place it
+    static const double registrationMinCells;
+
+    // Layout used when none is given
+    static const FormLayout defaultLayout;
+
 
 //===============// Attributes //===============//
     // Current row and column
@@ -191,11 +495,68 @@ private:
     // The Unchanged image
     cv::Mat m_unchangedImage;
 
+    // The unchanged image reduced for the detection (if the detection scale is not 1)
+    cv::Mat m_reducedImage;
+
+    // The extraction mode
+    ExtractionMode m_extractionMode;
+
+    // Reduction of the page used for the detection of the snippets
+    int m_detectionScale;
+
+    // The backend finding the snippets
+    DetectionBackend m_detectionBackend;
+
+    // The layout of the forms (optional, not owned)
+    const FormLayout* m_layout;
+
+    // Reduction of the current image
+    int m_imageScale;
+
+    // The sink receiving the snippets
+    SnippetSink* m_sink;
+
+    // The catalog recording the snippets (optional)
+    SnippetCatalog* m_catalog;
+
+    // The unchanged image rotated once (PageDeskew mode only)
+    cv::Mat m_deskewedImage;
+
+    // The rotation matrix from the unchanged image to the deskewed one
+    cv::Mat m_deskewMatrix;
+
+    // Cosine and sine of the page skew
+    double m_skewCos, m_skewSin;
+
     // The area of a snippet
     double m_snippetArea;
 
-    // Save contours
-    std::vector<std::vector<cv::Point> > m_snippetContours;
+    // All the contours found on the page, and their hierarchy
+    std::vector<std::vector<cv::Point> > m_contours;
+    std::vector<cv::Vec4i> m_hierarchy;
+
+    // Bounding boxes of the contours, and their areas
+    std::vector<cv::Rect> m_contourBoxes;
+    std::vector<double> m_contourAreas;
+
+    // Labels and statistics of the connected components (ConnectedComponents backend)
+    cv::Mat m_labels, m_stats, m_centroids;
+
+    // Mask and contours of a single component
+    cv::Mat m_componentMask;
+    std::vector<std::vector<cv::Point> > m_componentContours;
+
+    // Candidate snippets when placing the layout, candidate of each cell and its distance to the cell
+    std::vector<cv::Point2f> m_registrationPoints;
+    std::vector<int> m_registrationCells;
+    std::vector<double> m_registrationErrors;
+
+    // Matched positions on the layout and on the page, and the ones kept by the fit
+    std::vector<cv::Point2f> m_layoutPoints, m_pagePoints;
+    std::vector<uchar> m_registrationInliers;
+
+    // Save contours : index in m_contours of the contour of each snippet
+    std::vector<int> m_snippetContourIndexes;
 
     // Bounding boxes
     std::vector<cv::Rect> m_boundingBoxes;
@@ -206,12 +567,49 @@ private:
     // Matrice of indexes
     std::vector<std::vector<int> > m_indexgrid;
 
+    // Rows of the grid of a previous page, kept for their capacity
+    std::vector<std::vector<int> > m_spareRows;
+
+    // Spatial hash of the bounding boxes : side and number of the buckets
+    double m_bucketSize;
+    int m_bucketCols, m_bucketRows;
+
+    // Boxes of the bucket b : m_bucketBoxes[m_bucketStart[b]] to m_bucketBoxes[m_bucketStart[b + 1] - 1], by increasing index
+    std::vector<int> m_bucketStart;
+    std::vector<int> m_bucketBoxes;
+
+    // Next free place of each bucket while the spatial hash is built
+    std::vector<int> m_bucketNext;
+
 
     // Index of the first snippet
     int m_firstSnippet;
 
     // Vector for finding a snippet on the right or at the bottom
     cv::Point m_vectorRight, m_vectorBottom;
+
+    // Buffer of the region rotated around a snippet
+    cv::Mat m_rotatedSnippet;
+
+    // Fixed-point maps of the rotated region on the page (as computed by warpAffine for the whole page)
+    cv::Mat m_snippetMapXY, m_snippetMapA;
+
+    // Corners of the rotated region, mapped back on the page
+    std::vector<cv::Point2f> m_snippetCorners;
+
+    // Buffers of the deskewed snippets, for each row and column
+    // (a buffer still shared with a snippet given to the sink is replaced, not overwritten)
+    std::vector<std::vector<cv::Mat> > m_snippetBuffers;
+
+    // Snippets of the row being extracted by extractRow
+    std::vector<cv::Mat> m_rowSnippets;
+
+    // Buffers at the beginning of the current page, and number of allocations of the previous pages
+    BufferList m_buffers;
+    size_t m_nbAllocations;
+
+    // Number of allocations of all the extractors
+    static std::atomic<size_t> s_totalAllocations;
 };
 
 
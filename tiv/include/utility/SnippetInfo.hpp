@@ -0,0 +1,38 @@
+#ifndef PROJET_OPENCV_CMAKE_SNIPPETINFO_HPP
+#define PROJET_OPENCV_CMAKE_SNIPPETINFO_HPP
+
+#include <string>
+#include <ostream>
+
+/*
+ * The metadata describing an extracted snippet
+ */
+struct SnippetInfo {
+    // Path of the snippet files, without extension
+    std::string path;
+
+    // Label and size of the icon of the row
+    std::string label;
+    std::string size;
+
+    // Scripter and page numbers of the form
+    std::string scripter;
+    std::string page;
+
+    // Position of the snippet in the grid
+    unsigned int row;
+    unsigned int column;
+
+    /**
+     * Writes the content of the .txt file of the snippet
+     */
+    void writeText(std::ostream& txt) const;
+
+    /**
+     * Gets the name of the snippet (the file name of its path, which identifies it in the output)
+     */
+    std::string getName() const;
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SNIPPETINFO_HPP
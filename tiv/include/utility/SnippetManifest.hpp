@@ -0,0 +1,114 @@
+#ifndef PROJET_OPENCV_CMAKE_SNIPPETMANIFEST_HPP
+#define PROJET_OPENCV_CMAKE_SNIPPETMANIFEST_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+
+#include "utility/SnippetInfo.hpp"
+
+/*
+ * A single CSV file holding the metadata of all the snippets of a run,
+ * written incrementally instead of one .txt file per snippet
+ * Columns : path,label,size,scripter,page,row,column
+ */
+class SnippetManifest {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the path of the manifest, which is created (or emptied)
+     */
+    explicit SnippetManifest(const std::string& path);
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds the metadata of a snippet
+     * Thread safe : can be called by several workers at the same time
+     */
+    void append(const SnippetInfo& info);
+
+    /**
+     * Writes the buffered lines to the file
+     */
+    void flush();
+
+    /**
+     * Reads all the lines of a manifest
+     * @param infos filled with the metadata of the snippets, in the order they were appended
+     * @return false if the file could not be read
+     */
+    static bool load(const std::string& path, std::vector<SnippetInfo>& infos);
+
+private:
+
+//===============// Private constants //===============//
+
+    // First line of the file
+    static const std::string header;
+
+//===============// Attributes //===============//
+
+    // The manifest file
+    std::ofstream file;
+
+    // Protects the file
+    std::mutex mutex;
+
+};
+
+/*
+ * The content of a manifest, indexed by label, scripter and page
+ */
+class SnippetManifestIndex {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the content of a manifest
+     */
+    explicit SnippetManifestIndex(std::vector<SnippetInfo> infos);
+
+//===============// Public methods //===============//
+
+    /**
+     * Getter for the metadata of all the snippets
+     */
+    inline const std::vector<SnippetInfo>& getInfos() const {
+        return infos;
+    }
+
+    /**
+     * Finds the snippets matching the given label, scripter and page
+     * An empty string matches any value
+     * @return the indexes of the matching snippets in getInfos
+     */
+    std::vector<size_t> select(const std::string& label, const std::string& scripter, const std::string& page) const;
+
+    /**
+     * Finds a snippet from its name (the file name of its path)
+     * @return nullptr if there is no such snippet
+     */
+    const SnippetInfo* findByName(const std::string& name) const;
+
+private:
+
+//===============// Attributes //===============//
+
+    // Metadata of all the snippets
+    std::vector<SnippetInfo> infos;
+
+    // Indexes of the snippets for each label, scripter and page
+    std::map<std::string, std::vector<size_t>> byLabel, byScripter, byPage;
+
+    // Index of the snippet of each name
+    std::unordered_map<std::string, size_t> byName;
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SNIPPETMANIFEST_HPP
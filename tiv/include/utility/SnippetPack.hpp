@@ -0,0 +1,185 @@
+#ifndef PROJET_OPENCV_CMAKE_SNIPPETPACK_HPP
+#define PROJET_OPENCV_CMAKE_SNIPPETPACK_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include <opencv2/core.hpp>
+
+#include "utility/SnippetInfo.hpp"
+#include "utility/SnippetSink.hpp"
+
+/*
+ * A snippet stored in a pack file
+ */
+struct SnippetPackEntry {
+    // Position and length of the PNG data in the pack
+    uint64_t offset;
+    uint64_t length;
+
+    // Metadata of the snippet (the path is the name the snippet would have in the output directory)
+    SnippetInfo info;
+};
+
+/*
+ * A sink appending all the snippets of a run to a single pack file, instead of two small files per snippet
+ * Layout of the file :
+ *  - "TIVPACK1"
+ *  - the PNG data of each snippet, one after the other
+ *  - the index : for each snippet its offset, length, row, column (64/64/32/32 bits)
+ *    then its path, label, size, scripter and page (16 bits length + characters)
+ *  - the footer : offset of the index, number of snippets (64 bits each) and "TIVINDEX"
+ */
+class SnippetPackWriter : public SnippetSink {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the path of the pack, which is created (or emptied)
+     * @param manifest if given, the metadata of each snippet is also appended to it
+     */
+    explicit SnippetPackWriter(const std::string& path, SnippetManifest* manifest = nullptr);
+
+    /**
+     * Destructor
+     * Writes the index if close was not called
+     */
+    ~SnippetPackWriter() override;
+
+//===============// Public methods //===============//
+
+    /**
+     * Encodes the snippet in PNG and appends it to the pack
+     * Thread safe : the encoding is done outside of the lock
+     */
+    void consume(const cv::Mat& snippet, const SnippetInfo& info) override;
+
+    /**
+     * Calls the function at once, unless a snippet could not be written
+     */
+    void whenSaved(const std::function<void()>& callback) override;
+
+    /**
+     * Appends an already encoded snippet to the pack
+     * After a failed write, the snippets are dropped
+     */
+    void append(const std::vector<uchar>& png, const SnippetInfo& info);
+
+    /**
+     * Writes the index and the footer, then closes the file
+     * Nothing can be appended afterwards
+     * @return false if a snippet, the index or the footer could not be written
+     */
+    bool close();
+
+private:
+
+//===============// Attributes //===============//
+
+    // Path of the pack
+    std::string path;
+
+    // The pack file
+    std::ofstream file;
+
+    // Offset of the end of the PNG data
+    uint64_t offset;
+
+    // Index of the snippets already appended
+    std::vector<SnippetPackEntry> entries;
+
+    // True once the index is written
+    bool closed;
+
+    // True once a write failed
+    bool failed;
+
+    // The manifest receiving the metadata (optional)
+    SnippetManifest* manifest;
+
+    // Protects the file, the offset and the entries
+    std::mutex mutex;
+
+};
+
+/*
+ * Random access to the snippets of a pack file, which is memory-mapped
+ */
+class SnippetPackReader {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the path of the pack
+     * If it can not be read, isOpen returns false
+     */
+    explicit SnippetPackReader(const std::string& path);
+
+    /**
+     * Destructor
+     * Unmaps the file
+     */
+    ~SnippetPackReader();
+
+    SnippetPackReader(const SnippetPackReader&) = delete;
+    SnippetPackReader& operator=(const SnippetPackReader&) = delete;
+
+//===============// Public methods //===============//
+
+    /**
+     * True if the pack was mapped and its index read
+     */
+    inline bool isOpen() const {
+        return data != nullptr;
+    }
+
+    /**
+     * Getter for the index of the pack
+     */
+    inline const std::vector<SnippetPackEntry>& getEntries() const {
+        return entries;
+    }
+
+    /**
+     * Finds a snippet from its name (the file name of its path)
+     * @param index filled with the index of the snippet in the entries
+     * @return false if there is no such snippet
+     */
+    bool findByName(const std::string& name, size_t& index) const;
+
+    /**
+     * Decodes the picture of a snippet, directly from the mapped memory
+     * @param index the index of the snippet in the entries
+     */
+    cv::Mat decode(size_t index) const;
+
+private:
+
+//===============// Attributes //===============//
+
+    // The mapped file
+    const uchar* data;
+    size_t size;
+
+    // Index of the snippets
+    std::vector<SnippetPackEntry> entries;
+
+    // Index of the entry of each name
+    std::unordered_map<std::string, size_t> byName;
+
+//===============// Private methods //===============//
+
+    /**
+     * Reads the index of the mapped file
+     * @return false if the file is not a valid pack
+     */
+    bool readIndex();
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SNIPPETPACK_HPP
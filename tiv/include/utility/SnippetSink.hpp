@@ -0,0 +1,78 @@
+#ifndef PROJET_OPENCV_CMAKE_SNIPPETSINK_HPP
+#define PROJET_OPENCV_CMAKE_SNIPPETSINK_HPP
+
+#include <functional>
+
+#include <opencv2/core.hpp>
+
+#include "utility/SnippetInfo.hpp"
+
+class SnippetManifest;
+
+/*
+ * Interface of the consumers of the extracted snippets
+ * A SnippetExtractor gives each snippet it extracts to its sink
+ * A sink can be shared by several extractors, so consume must be thread safe
+ */
+class SnippetSink {
+public:
+    virtual ~SnippetSink() = default;
+
+    /**
+     * Receives an extracted snippet
+     * @param snippet the snippet picture (its pixels are shared with the extractor : clone it to modify it)
+     * @param info the label, size, scripter, page, row and column of the snippet
+     */
+    virtual void consume(const cv::Mat& snippet, const SnippetInfo& info) = 0;
+
+    /**
+     * Calls a function once every snippet consumed before the call is saved
+     * The sinks saving the snippets in consume call it at once
+     */
+    virtual void whenSaved(const std::function<void()>& callback) {
+        callback();
+    }
+};
+
+/*
+ * A sink saving each snippet synchronously as info.path + ".png" and info.path + ".txt"
+ * This is the default sink of the extractors
+ */
+class DiskSnippetSink : public SnippetSink {
+public:
+    /**
+     * Constructor
+     * @param manifest if given, the metadata is appended to it instead of being written in a .txt file per snippet
+     */
+    explicit DiskSnippetSink(SnippetManifest* manifest = nullptr);
+
+    void consume(const cv::Mat& snippet, const SnippetInfo& info) override;
+
+private:
+    // The manifest receiving the metadata (nullptr for .txt files)
+    SnippetManifest* manifest;
+};
+
+/*
+ * A sink forwarding each snippet to a function, to consume the snippets in the same process
+ * without going through the disk
+ */
+class CallbackSnippetSink : public SnippetSink {
+public:
+    typedef std::function<void(const cv::Mat&, const SnippetInfo&)> Callback;
+
+    /**
+     * Constructor with the function called for each snippet
+     * It must be thread safe if the sink is shared by several extractors
+     */
+    explicit CallbackSnippetSink(Callback callback);
+
+    void consume(const cv::Mat& snippet, const SnippetInfo& info) override;
+
+private:
+    // The function called for each snippet
+    Callback callback;
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_SNIPPETSINK_HPP
@@ -0,0 +1,87 @@
+#ifndef PROJET_OPENCV_CMAKE_THREADPOOL_HPP
+#define PROJET_OPENCV_CMAKE_THREADPOOL_HPP
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * A fixed size pool of worker threads executing tasks in the order they were submitted
+ */
+class ThreadPool {
+public:
+//===============// Constructor //===============//
+
+    /**
+     * Constructor with the number of workers
+     * @param nbThreads the number of worker threads (at least 1)
+     */
+    explicit ThreadPool(unsigned int nbThreads);
+
+    /**
+     * Destructor
+     * Waits for all the submitted tasks then stops the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+//===============// Public methods //===============//
+
+    /**
+     * Adds a task to the queue, it will be run by the first available worker
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * Blocks until all the submitted tasks are done
+     */
+    void wait();
+
+    /**
+     * Getter for the number of workers
+     */
+    inline unsigned int getNumberThreads() const {
+        return workers.size();
+    }
+
+private:
+
+//===============// Attributes //===============//
+
+    // The worker threads
+    std::vector<std::thread> workers;
+
+    // Tasks waiting for a worker
+    std::queue<std::function<void()>> tasks;
+
+    // Number of tasks being run
+    unsigned int nbRunning;
+
+    // True when the workers must stop
+    bool stopping;
+
+    // Protects the queue, the running count and the stopping flag
+    std::mutex mutex;
+
+    // Notified when a task is submitted or when the pool stops
+    std::condition_variable taskAvailable;
+
+    // Notified when a task is done
+    std::condition_variable taskDone;
+
+//===============// Private methods //===============//
+
+    /**
+     * Loop run by each worker : takes the tasks from the queue until the pool stops
+     */
+    void workerLoop();
+
+};
+
+
+#endif //PROJET_OPENCV_CMAKE_THREADPOOL_HPP
@@ -2,7 +2,15 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <sys/stat.h>
 
+#include "opencv2/core/utility.hpp"
 #include "opencv2/imgcodecs.hpp"
 using namespace cv;
 
@@ -11,6 +19,127 @@ using namespace cv;
 #include <utility/SnippetExtractor.hpp>
 #include "utility/DataPathGenerator.hpp"
 #include "utility/QualityChecker.hpp"
+#include "utility/ThreadPool.hpp"
+#include "utility/FormPipeline.hpp"
+#include "utility/AsyncSnippetWriter.hpp"
+#include "utility/SnippetPack.hpp"
+#include "utility/SnippetManifest.hpp"
+#include "utility/SnippetCatalog.hpp"
+#include "utility/RunJournal.hpp"
+#include "utility/FormLayout.hpp"
+#include "utility/RecognitionCache.hpp"
+#include "utility/ReferenceHashCache.hpp"
+
+/*
+ * Options given on the command line
+ */
+struct RunOptions {
+    // Number of forms processed at the same time
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Extraction mode of the snippets
+    SnippetExtractor::ExtractionMode extractionMode = SnippetExtractor::ExtractionMode::PerSnippet;
+
+    // Reduction of the page for the detection of the snippets
+    int detectionScale = 1;
+
+    // Backend finding the snippets on the page
+    SnippetExtractor::DetectionBackend detectionBackend = SnippetExtractor::DetectionBackend::Contours;
+
+    // Use the staged pipeline instead of one task per form
+    bool pipeline = false;
+
+    // Save the snippets with a background writer
+    bool asyncWrite = false;
+
+    // Append all the snippets to a single pack file instead of separate files
+    bool pack = false;
+
+    // Write the metadata of all the snippets in a single manifest instead of .txt files
+    bool manifest = false;
+
+    // Only process the forms that are new or modified since the previous runs
+    bool incremental = false;
+
+    // Layout of the forms placed on each page (learned from the first form if the file does not exist)
+    std::string layoutPath;
+
+    // Learn the labels and sizes of the rows of each page, and only verify them on the next forms
+    bool pageCache = false;
+
+    // Give the result of an already recognized reference to the near-identical ones
+    bool hashCache = false;
+
+    // Only match the labels ranked first by a cheap global descriptor
+    ImageRecognitionManager::Prefilter prefilter = ImageRecognitionManager::Prefilter::None;
+    int cascadeTopK = 4;
+
+    // Recognize the size words with the size classifier instead of ORB
+    bool fastSize = false;
+};
+
+void parseOptions(int argc, char** argv, RunOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--threads" && i + 1 < argc) {
+            options.nbThreads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--page-deskew") {
+            options.extractionMode = SnippetExtractor::ExtractionMode::PageDeskew;
+        } else if (arg == "--detection-scale" && i + 1 < argc) {
+            options.detectionScale = std::atoi(argv[++i]);
+            if (options.detectionScale != 1 && options.detectionScale != 2 && options.detectionScale != 4) {
+                std::cerr << "The detection scale must be 1, 2 or 4" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--components") {
+            options.detectionBackend = SnippetExtractor::DetectionBackend::ConnectedComponents;
+        } else if (arg == "--pipeline") {
+            options.pipeline = true;
+        } else if (arg == "--async-write") {
+            options.asyncWrite = true;
+        } else if (arg == "--pack") {
+            options.pack = true;
+        } else if (arg == "--manifest") {
+            options.manifest = true;
+        } else if (arg == "--incremental") {
+            options.incremental = true;
+        } else if (arg == "--layout" && i + 1 < argc) {
+            options.layoutPath = argv[++i];
+        } else if (arg == "--page-cache") {
+            options.pageCache = true;
+        } else if (arg == "--hash-cache") {
+            options.hashCache = true;
+        } else if (arg == "--cascade" && i + 1 < argc) {
+            std::string prefilter(argv[++i]);
+            if (prefilter == "correlation") {
+                options.prefilter = ImageRecognitionManager::Prefilter::Correlation;
+            } else if (prefilter == "edges") {
+                options.prefilter = ImageRecognitionManager::Prefilter::EdgeHistogram;
+            } else {
+                std::cerr << "The cascade prefilter must be correlation or edges" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--cascade-k" && i + 1 < argc) {
+            options.cascadeTopK = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--fast-size") {
+            options.fastSize = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--page-deskew] [--detection-scale 1|2|4] [--components]"
+                      << " [--pipeline] [--async-write] [--pack] [--manifest] [--incremental] [--layout FILE]"
+                      << " [--page-cache] [--hash-cache] [--cascade correlation|edges] [--cascade-k N]"
+                      << " [--fast-size]"
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The pack is rewritten by each run : it would lose the snippets of the skipped forms
+    if (options.incremental && options.pack) {
+        std::cerr << "--incremental cannot be used with --pack" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
 
 void openImage(const std::string& path, cv::Mat& res) {
     res = imread(path);
@@ -20,19 +149,165 @@ void openImage(const std::string& path, cv::Mat& res) {
     }
 }
 
-int main () {
+/**
+ * Processes a single form : every form is independent, so this can be run by several workers at once
+ * The image recognition manager is only read, the generator and the checker are thread safe
+ */
+void processForm(const std::string& img, const RunOptions& options, const ImageRecognitionManager& imgManager,
+                 DataPathGenerator& generator, QualityChecker& checker, SnippetSink* sink,
+                 SnippetCatalog& catalog, RunJournal* journal, const FormLayout* layout,
+                 RecognitionCache* recognitionCache, ReferenceHashCache* hashCache) {
+    // Open the current image and put it in a matrix
+    cv::Mat m;
+    openImage(img, m);
+
+    // Set the image on which we extract the informations
+    // (each worker keeps its extractor, and its buffers, from one form to the next)
+    static thread_local SnippetExtractor extractor;
+    extractor.setExtractionMode(options.extractionMode);
+    extractor.setDetectionScale(options.detectionScale);
+    extractor.setDetectionBackend(options.detectionBackend);
+    extractor.setLayout(layout);
+    extractor.setSink(sink);
+    extractor.setCatalog(&catalog);
+
+    // Skip images with no snippets
+    // (the extractor takes the image without copy)
+    if (!extractor.setImage(std::move(m))) {
+        std::cout << "Skipped : " << img << std::endl;
+        if (journal) {
+            journal->markDone(img, std::vector<SnippetInfo>());
+        }
+        return;
+    }
+
+    // Extract the ID of the form
+    //extractor.getFormID(extractor.getImage(), formId);
+
+    // Recognize it using the text extraction manager
+    //formIdText = textManager.TextExtractionAlgorithm(formId).substr(0, 5);
+
+    // The output file names only depend on this id, the row and the column : they do not depend on the workers
+    std::string formIdText;
+    for (auto i=0 ; i < img.length(); i++ ){ if ( isdigit(img[i]) ) formIdText+=img[i]; }
+
+
+    // Add it to the idToPath map
+    generator.putPathWithId(formIdText, img);
+
+    // Extract the reference label (and size if present)
+    std::vector<cv::Mat> references;
+    extractor.getReferences(extractor.getImage(), references);
+
+    // For each row
+    const std::string page = formIdText.substr(2, 4);
+    for (int j = 0; j < extractor.getNumberRows(); j++) {
+        // The rows already learned on this page are only verified
+        std::pair<std::string, std::string> rowLabelSize;
+        if (!recognitionCache || !recognitionCache->lookup(page, j, references[j], rowLabelSize)) {
+            // A reference close to an already recognized one gets its result
+            // (a weak hit, with a few different bits, is recognized again)
+            uint64_t hash = hashCache ? ReferenceHashCache::getHash(references[j]) : 0;
+            double confidence;
+            if (!hashCache || !hashCache->lookup(hash, rowLabelSize, confidence) ||
+                confidence < ReferenceHashCache::minConfidence) {
+                // Recognize the reference label + size using the image recognition manager
+                // (the reference crop is featurized once and matched against every base image)
+                ImageRecognitionManager::Features rowFeatures = imgManager.computeFeatures(references[j]);
+                rowLabelSize = imgManager.imageRecognitionAlgorithm(rowFeatures);
+                if (hashCache) {
+                    hashCache->record(hash, rowLabelSize);
+                }
+            }
+            if (recognitionCache) {
+                recognitionCache->record(page, j, references[j], rowLabelSize);
+            }
+        }
+
+        // Counting labels in the quality checker
+        if(!rowLabelSize.first.empty())
+        checker.putLabel(rowLabelSize.first);
+
+        // Extract the snippets on the row with the given label + size
+        if(!rowLabelSize.first.empty())
+        extractor.extractRow(j, rowLabelSize.first, rowLabelSize.second, formIdText.substr(0, 2), formIdText.substr(2, 4));
+    }
+
+    // The form is completed once its snippets are saved
+    if (journal) {
+        std::vector<SnippetInfo> snippets = catalog.getForm(formIdText.substr(0, 6));
+        std::function<void()> done = [journal, img, snippets] { journal->markDone(img, snippets); };
+        if (sink) {
+            sink->whenSaved(done);
+        } else {
+            done();
+        }
+    }
+}
+
+/**
+ * Measures the layout of the forms on a form whose snippets are detected
+ * @return false if the grid of the form could not be found
+ */
+bool learnLayout(const std::string& img, FormLayout& layout) {
+    cv::Mat m;
+    openImage(img, m);
+
+    SnippetExtractor extractor;
+    return extractor.setImage(std::move(m)) && extractor.getLayout(layout);
+}
+
+/**
+ * Removes the files of snippets saved by a previous run
+ */
+void removeSnippets(const std::vector<SnippetInfo>& snippets) {
+    for (const SnippetInfo& info : snippets) {
+        std::remove((info.path + ".png").c_str());
+        std::remove((info.path + ".txt").c_str());
+    }
+}
+
+/**
+ * Restores a form completed by a previous run, as if it was processed again
+ * @param snippets the snippets it produced, recorded in the journal
+ */
+void restoreForm(const std::string& img, const std::vector<SnippetInfo>& snippets, DataPathGenerator& generator,
+                 QualityChecker& checker, SnippetCatalog& catalog, SnippetManifest* manifest) {
+    std::string formIdText;
+    for (char c : img) { if (isdigit(c)) formIdText += c; }
+    generator.putPathWithId(formIdText, img);
+
+    int lastRow = -1;
+    for (const SnippetInfo& info : snippets) {
+        // The label of each row is counted once
+        if ((int) info.row != lastRow) {
+            checker.putLabel(info.label);
+            lastRow = info.row;
+        }
+        catalog.add(info);
+        if (manifest) {
+            manifest->append(info);
+        }
+    }
+}
+
+int main (int argc, char** argv) {
+
+    RunOptions options;
+    parseOptions(argc, argv, options);
 
     /** STEP 0 : We setup the quality checker and start the chrono - for performances measures **/
     QualityChecker checker;
     auto start = std::chrono::steady_clock::now();
 
     /** STEP 1 : Get all image path from the base **/
-    DataPathGenerator generator("donnees", "output");
+    DataPathGenerator generator("donnees", "output", !options.incremental);
 
     std::vector<std::string> pathToImages;
     generator.generatePath(pathToImages);
 
     std::cout << "Number of images to process : " << pathToImages.size() << std::endl;
+    std::cout << "Number of threads : " << options.nbThreads << std::endl;
 
     /** STEP 3 : For a given image :
      * Extract the ID of the form
@@ -43,59 +318,168 @@ int main () {
      *  - Extract the snippets on the row with the given label + size
      *  - Repeat
      * Repeat the process until all image are processed
+     * The images are distributed among the workers of a thread pool,
+     * or go through the stages of a pipeline (decode -> binarize -> grid -> recognize -> extract -> encode)
     **/
 
     //TextExtractionManager textManager;
     ImageRecognitionManager imgManager;
-    std::string formIdText;
+    imgManager.setCascade(options.prefilter, options.cascadeTopK);
+    // (the sizes are recognized with ORB if the size classifier cannot be built)
+    options.fastSize = imgManager.setFastSizeDetection(options.fastSize);
     // cv::Mat formId;
 
-    for (std::string& img : pathToImages) {
+    // The forms are already processed in parallel : avoid oversubscribing the cores with OpenCV's own threads
+    if (options.nbThreads > 1) {
+        cv::setNumThreads(1);
+    }
 
-        // Open the current image and put it in a matrix
-        cv::Mat m;
-        openImage(img, m);
+    // The snippets can be appended to a pack, or encoded and written by dedicated threads
+    // and their metadata can go to a single manifest
+    const std::string packPath = "output/snippets.pack";
+    const std::string manifestPath = "output/manifest.csv";
+    const std::string journalPath = "output/journal.bin";
+    mkdir("output", 0777);
+    std::unique_ptr<SnippetManifest> manifest;
+    std::unique_ptr<SnippetPackWriter> packWriter;
+    std::unique_ptr<AsyncSnippetWriter> writer;
+    std::unique_ptr<DiskSnippetSink> diskSink;
+    SnippetSink* sink = nullptr;
+    // Every snippet is recorded in a catalog, the quality check does not have to list the output
+    SnippetCatalog catalog;
 
-        // Set the image on which we extract the informations
-        SnippetExtractor extractor;
+    if (options.manifest) {
+        manifest.reset(new SnippetManifest(manifestPath));
+    }
+    if (options.pack) {
+        packWriter.reset(new SnippetPackWriter(packPath, manifest.get()));
+        sink = packWriter.get();
+    } else if (options.asyncWrite) {
+        writer.reset(new AsyncSnippetWriter(std::max(1u, options.nbThreads / 4), 4, 16, 1024, manifest.get()));
+        sink = writer.get();
+    } else if (manifest) {
+        diskSink.reset(new DiskSnippetSink(manifest.get()));
+        sink = diskSink.get();
+    }
 
-        // Skip images with no snippets
-        if (!extractor.setImage(m)) {
-            std::cout << "Skipped : " << img << std::endl;
-            continue;
+    // The layout of the forms is placed on each page instead of detecting the snippets
+    FormLayout layout;
+    const FormLayout* formLayout = nullptr;
+    if (!options.layoutPath.empty()) {
+        // An existing layout is never overwritten : it is learned only when the file does not exist
+        struct stat layoutStat;
+        if (stat(options.layoutPath.c_str(), &layoutStat) == 0) {
+            if (!FormLayout::load(options.layoutPath, layout)) {
+                std::cerr << "Could not load the layout " << options.layoutPath << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            formLayout = &layout;
+        } else if (!pathToImages.empty() && learnLayout(pathToImages.front(), layout)) {
+            layout.save(options.layoutPath);
+            std::cout << "Layout learned from " << pathToImages.front() << " : " << layout.rows << "x"
+                      << layout.columns << " snippets" << std::endl;
+            formLayout = &layout;
+        } else {
+            std::cerr << "Could not learn the layout, the snippets are detected on each page" << std::endl;
         }
+    }
 
-        // Extract the ID of the form
-        //extractor.getFormID(m, formId);
-
-        // Recognize it using the text extraction manager
-        //formIdText = textManager.TextExtractionAlgorithm(formId).substr(0, 5);
-
-        std::string formIdText;
-        for (auto i=0 ; i < img.length(); i++ ){ if ( isdigit(img[i]) ) formIdText+=img[i]; }
+    // The rows of the pages already seen are verified instead of recognized
+    std::unique_ptr<RecognitionCache> recognitionCache;
+    if (options.pageCache) {
+        recognitionCache.reset(new RecognitionCache());
+    }
+    std::unique_ptr<ReferenceHashCache> hashCache;
+    if (options.hashCache) {
+        hashCache.reset(new ReferenceHashCache());
+    }
 
+    // Only the new or modified forms are processed, the others are restored from the journal
+    std::unique_ptr<RunJournal> journal;
+    if (options.incremental) {
+        std::string version = RunJournal::pipelineVersion +
+                (options.extractionMode == SnippetExtractor::ExtractionMode::PageDeskew ? "-page" : "-snippet") +
+                "-x" + std::to_string(options.detectionScale) +
+                (options.detectionBackend == SnippetExtractor::DetectionBackend::ConnectedComponents ? "-cc" : "") +
+                (formLayout ? "-layout" : "") +
+                (options.prefilter != ImageRecognitionManager::Prefilter::None ?
+                 "-cascade" + std::to_string((int) options.prefilter) + "k" + std::to_string(options.cascadeTopK) : "") +
+                (options.fastSize ? "-fastsize" : "") +
+                (options.pageCache ? "-pagecache" : "") +
+                (options.hashCache ? "-hashcache" : "");
+        journal.reset(new RunJournal(journalPath, version));
 
-        // Add it to the idToPath map
-        generator.putPathWithId(formIdText, img);
+        // The outputs of the forms which are not inputs anymore are removed
+        std::vector<SnippetInfo> removed;
+        journal->prune(pathToImages, removed);
+        removeSnippets(removed);
 
-        // Extract the reference label (and size if present)
-        std::vector<cv::Mat> references;
-        extractor.getReferences(m, references);
+        std::vector<char> completed(pathToImages.size(), 0);
+        {
+            ThreadPool pool(options.nbThreads);
+            for (size_t i = 0; i < pathToImages.size(); i++) {
+                pool.submit([i, &pathToImages, &completed, &journal, &generator, &checker, &catalog, &manifest] {
+                    std::vector<SnippetInfo> snippets;
+                    if (journal->check(pathToImages[i], snippets)) {
+                        restoreForm(pathToImages[i], snippets, generator, checker, catalog, manifest.get());
+                        completed[i] = 1;
+                    } else if (journal->getOutdated(pathToImages[i], snippets)) {
+                        // Its previous outputs could have another label : they are removed before processing it again
+                        removeSnippets(snippets);
+                    }
+                });
+            }
+            pool.wait();
+        }
 
-        // For each row
-        for (int j = 0; j < extractor.getNumberRows(); j++) {
-            // Recognize the reference label + size using the image recognition manager
-            std::pair<std::string, std::string> rowLabelSize = imgManager.imageRecognitionAlgorithm(references[j]);
+        std::vector<std::string> remaining;
+        for (size_t i = 0; i < pathToImages.size(); i++) {
+            if (!completed[i]) remaining.push_back(pathToImages[i]);
+        }
+        std::cout << "Already processed : " << pathToImages.size() - remaining.size() << " images" << std::endl;
+        pathToImages.swap(remaining);
+    }
 
-            // Counting labels in the quality checker
-            if(!rowLabelSize.first.empty())
-            checker.putLabel(rowLabelSize.first);
+    if (options.pipeline) {
+        FormPipeline::Config config = FormPipeline::defaultConfig(options.nbThreads);
+        config.extractionMode = options.extractionMode;
+        config.detectionScale = options.detectionScale;
+        config.detectionBackend = options.detectionBackend;
+        config.layout = formLayout;
+        config.sink = sink;
+        config.catalog = &catalog;
+        config.journal = journal.get();
+        config.recognitionCache = recognitionCache.get();
+        config.hashCache = hashCache.get();
+        FormPipeline pipeline(config, imgManager, generator, checker);
+        pipeline.run(pathToImages);
+    } else {
+        ThreadPool pool(options.nbThreads);
+        for (const std::string& img : pathToImages) {
+            pool.submit([&img, &options, &imgManager, &generator, &checker, sink, &catalog, &journal, formLayout,
+                         &recognitionCache, &hashCache] {
+                processForm(img, options, imgManager, generator, checker, sink, catalog, journal.get(), formLayout,
+                            recognitionCache.get(), hashCache.get());
+            });
+        }
+        pool.wait();
+    }
 
-            // Extract the snippets on the row with the given label + size
-            if(!rowLabelSize.first.empty())
-            extractor.extractRow(j, rowLabelSize.first, rowLabelSize.second, formIdText.substr(0, 2), formIdText.substr(2, 4));
+    // Wait for the last snippets to be on the disk
+    if (writer) {
+        writer->flush();
+    }
+    if (packWriter) {
+        if (!packWriter->close()) {
+            exit(EXIT_FAILURE);
         }
+        generator.setPackPath(packPath);
+    }
+    if (manifest) {
+        manifest->flush();
+        generator.setManifestPath(manifestPath);
     }
+    generator.setCatalog(&catalog);
 
     /** STEP 4 : We check the algorithm performances **/
     std::cout << "==========================" << std::endl;
@@ -105,6 +489,15 @@ int main () {
     auto end = std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed_seconds = end-start;
     std::cout << "Execution duration : " << elapsed_seconds.count() << " sec" << std::endl;
+    // (the workers and their extractors are destroyed : the allocations of their last page are counted)
+    std::cout << "Buffer allocations of the extractors : " << SnippetExtractor::getTotalAllocations() << std::endl;
+    if (recognitionCache) {
+        std::cout << "Rows verified by the page cache : " << recognitionCache->getNumberHits() << std::endl;
+    }
+    if (hashCache) {
+        std::cout << "Hash cache : " << hashCache->getNumberHits() << " hits, "
+                  << hashCache->getNumberMisses() << " misses" << std::endl;
+    }
     std::cout << "==========================" << std::endl;
 
 }
@@ -0,0 +1,179 @@
+#include "utility/AsyncSnippetWriter.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+
+AsyncSnippetWriter::AsyncSnippetWriter(unsigned int nbEncoders, unsigned int nbWriters, size_t batchSize,
+                                       size_t queueCapacity, SnippetManifest* manifest) :
+        batchSize(std::max<size_t>(1, batchSize)),
+        manifest(manifest),
+        rawQueue(queueCapacity),
+        encodedQueue(queueCapacity),
+        nbQueued(0),
+        nbContiguous(0),
+        nbWritten(0),
+        failed(false),
+        firstFailed(0),
+        nbRunningCallbacks(0) {
+    for (unsigned int i = 0; i < std::max(1u, nbEncoders); i++) {
+        encoders.emplace_back(&AsyncSnippetWriter::encodeLoop, this);
+    }
+    for (unsigned int i = 0; i < std::max(1u, nbWriters); i++) {
+        writers.emplace_back(&AsyncSnippetWriter::writeLoop, this);
+    }
+}
+
+AsyncSnippetWriter::~AsyncSnippetWriter() {
+    // The encoders stop once the raw queue is drained, then the writers once the encoded one is
+    rawQueue.close();
+    for (std::thread& encoder : encoders) {
+        encoder.join();
+    }
+    encodedQueue.close();
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+}
+
+void AsyncSnippetWriter::write(const cv::Mat& snippet, const SnippetInfo& info) {
+    size_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(countMutex);
+        sequence = nbQueued++;
+    }
+    rawQueue.push(RawSnippet{snippet, info, sequence});
+}
+
+void AsyncSnippetWriter::consume(const cv::Mat& snippet, const SnippetInfo& info) {
+    write(snippet, info);
+}
+
+void AsyncSnippetWriter::flush() {
+    std::unique_lock<std::mutex> lock(countMutex);
+    size_t target = nbQueued;
+    batchWritten.wait(lock, [this, target] { return nbWritten >= target; });
+}
+
+void AsyncSnippetWriter::whenSaved(const std::function<void()>& callback) {
+    {
+        std::lock_guard<std::mutex> lock(countMutex);
+        if (failed && firstFailed < nbQueued) {
+            return; // one of the snippets was not saved
+        }
+        if (nbWritten < nbQueued) {
+            savedCallbacks.emplace_back(nbQueued, callback);
+            return;
+        }
+    }
+    callback();
+}
+
+void AsyncSnippetWriter::encodeLoop() {
+    RawSnippet raw;
+    while (rawQueue.pop(raw)) {
+        EncodedSnippet encoded;
+        cv::imencode(".png", raw.snippet, encoded.png);
+        encoded.info = std::move(raw.info);
+        encoded.sequence = raw.sequence;
+        raw.snippet.release();
+        encodedQueue.push(std::move(encoded));
+    }
+}
+
+void AsyncSnippetWriter::writeLoop() {
+    std::vector<EncodedSnippet> batch;
+    std::vector<size_t> failures;
+    EncodedSnippet encoded;
+    while (encodedQueue.pop(encoded)) {
+        // Take the snippets already encoded up to the batch size
+        batch.push_back(std::move(encoded));
+        while (batch.size() < batchSize && encodedQueue.tryPop(encoded)) {
+            batch.push_back(std::move(encoded));
+        }
+
+        writeBatch(batch, failures);
+
+        // The snippets are encoded and written in parallel : only the first ones all written count
+        std::unique_lock<std::mutex> lock(countMutex);
+        for (const EncodedSnippet& written : batch) {
+            writtenAhead.insert(written.sequence);
+        }
+        for (size_t sequence : failures) {
+            firstFailed = failed ? std::min(firstFailed, sequence) : sequence;
+            failed = true;
+        }
+        while (!writtenAhead.empty() && *writtenAhead.begin() == nbContiguous) {
+            writtenAhead.erase(writtenAhead.begin());
+            nbContiguous++;
+        }
+
+        // The functions waiting for these snippets are called (without the lock) before the snippets are counted,
+        // so that flush only returns once they are done
+        // (the ones waiting for a snippet which could not be written are dropped)
+        while (true) {
+            size_t watermark = nbContiguous;
+            auto waiting = std::partition(savedCallbacks.begin(), savedCallbacks.end(),
+                    [watermark] (const std::pair<size_t, std::function<void()>>& c) {return c.first > watermark;});
+            if (waiting == savedCallbacks.end()) {
+                break;
+            }
+            std::vector<std::function<void()>> ready;
+            for (auto it = waiting; it != savedCallbacks.end(); it++) {
+                if (!failed || it->first <= firstFailed) {
+                    ready.push_back(std::move(it->second));
+                }
+            }
+            savedCallbacks.erase(waiting, savedCallbacks.end());
+
+            nbRunningCallbacks++;
+            lock.unlock();
+            for (const std::function<void()>& callback : ready) {
+                callback();
+            }
+            lock.lock();
+            nbRunningCallbacks--;
+        }
+
+        // Another writer may still be calling the functions of the previous snippets
+        if (nbRunningCallbacks == 0) {
+            nbWritten = nbContiguous;
+        }
+        lock.unlock();
+
+        batchWritten.notify_all();
+        batch.clear();
+        failures.clear();
+    }
+}
+
+void AsyncSnippetWriter::writeBatch(const std::vector<EncodedSnippet>& batch, std::vector<size_t>& failures) const {
+    for (const EncodedSnippet& encoded : batch) {
+        // Save the Snippet picture (a short write on a full or network volume is a failure too)
+        std::ofstream png(encoded.info.path + ".png", std::ios::binary);
+        png.write(reinterpret_cast<const char*>(encoded.png.data()), encoded.png.size());
+        png.close();
+        if (!png) {
+            std::cerr << "Could not write file " << encoded.info.path << ".png" << std::endl;
+            failures.push_back(encoded.sequence);
+            continue;
+        }
+
+        // The metadata goes to the manifest if there is one
+        if (manifest) {
+            manifest->append(encoded.info);
+            continue;
+        }
+
+        // Write the Txt File
+        std::ofstream txt(encoded.info.path + ".txt");
+        encoded.info.writeText(txt);
+        txt.close();
+        if (!txt) {
+            std::cerr << "Could not write file " << encoded.info.path << ".txt" << std::endl;
+            failures.push_back(encoded.sequence);
+        }
+    }
+}
@@ -5,11 +5,17 @@
 #include "utility/DataPathGenerator.hpp"
 #include <regex>
 #include <random>
+#include <fstream>
+#include <sstream>
+
+#include <opencv2/imgcodecs.hpp>
 
 namespace fs = std::__fs::filesystem;
 
-DataPathGenerator::DataPathGenerator(const std::string& path, const std::string& outputPath) : baseDirectory(path), outputDirectory(outputPath), idToPath() {
-    std::cout << "Deleted " << fs::remove_all(outputPath) << " files or directories" << std::endl;
+DataPathGenerator::DataPathGenerator(const std::string& path, const std::string& outputPath, bool clearOutput) : baseDirectory(path), outputDirectory(outputPath), idToPath(), catalog(nullptr) {
+    if (clearOutput) {
+        std::cout << "Deleted " << fs::remove_all(outputPath) << " files or directories" << std::endl;
+    }
 }
 
 
@@ -29,6 +35,7 @@ void DataPathGenerator::generatePath(std::vector<std::string>& output) const {
 }
 
 void DataPathGenerator::putPathWithId(const std::string& id, const std::string& path) {
+    std::lock_guard<std::mutex> lock(idMutex);
     idToPath.emplace(id, path);
 }
 
@@ -42,15 +49,52 @@ int DataPathGenerator::randomNumber(int lowerBound, int upperBound) const {
 
 std::pair<std::string, std::string> DataPathGenerator::randomOutputPath() const {
     // we choose a random id among all forms
+    std::unique_lock<std::mutex> lock(idMutex);
     int rand = randomNumber(0, idToPath.size() - 1);
     auto it = idToPath.begin();
     std::advance(it, rand);
     std::string id = (*it).first;
     std::string path = (*it).second;
 
+    lock.unlock();
+
     std::cout << "ID : " << id << std::endl;
     std::cout << "PATH : " << path << std::endl;
 
+    std::vector<std::string> goodMatches;
+
+    if (catalog) {
+        // every snippet was recorded : pick one of the form directly
+        size_t count = catalog->countForm(id);
+        SnippetInfo info;
+        if (count == 0 || !catalog->getFormSnippet(id, randomNumber(0, count - 1), info)) {
+            std::cerr << "No snippet found in the catalog for the form " << id << std::endl;
+            return std::make_pair(path, std::string());
+        }
+
+        std::string name = info.getName();
+        std::cout << name << std::endl;
+        return std::make_pair(path, name);
+    }
+
+    if (const SnippetPackReader* pack = getPackReader()) {
+        // the output is in a pack : its index gives the snippets of the form directly
+        for (const SnippetPackEntry& entry : pack->getEntries()) {
+            if (entry.info.scripter + entry.info.page == id) {
+                goodMatches.push_back(entry.info.getName());
+            }
+        }
+
+        if (goodMatches.empty()) {
+            std::cerr << "No snippet found in the pack for the form " << id << std::endl;
+            return std::make_pair(path, std::string());
+        }
+
+        rand = randomNumber(0, goodMatches.size() - 1);
+        std::cout << goodMatches[rand] << std::endl;
+        return std::make_pair(path, goodMatches[rand]);
+    }
+
     // we get all path in the output directory
     std::vector<std::string> output;
     generatePath(output, false);
@@ -59,7 +103,6 @@ std::pair<std::string, std::string> DataPathGenerator::randomOutputPath() const
     std::smatch m;
     std::string regex = "([a-zA-Z]+_"+ id.substr(0, 3) +"_" + id.substr(3, 2) + "_[0-9]_[0-9])";
     std::regex e(regex);
-    std::vector<std::string> goodMatches;
 
     // we go through all path
     for (const std::string& s : output) {
@@ -79,3 +122,89 @@ std::pair<std::string, std::string> DataPathGenerator::randomOutputPath() const
     return std::make_pair(path, goodMatches[rand]);
 }
 
+
+void DataPathGenerator::setPackPath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(idMutex);
+    packPath = path;
+    packReader.reset();
+}
+
+const SnippetPackReader* DataPathGenerator::getPackReader() const {
+    std::lock_guard<std::mutex> lock(idMutex);
+    if (packPath.empty()) {
+        return nullptr;
+    }
+    if (!packReader) {
+        packReader.reset(new SnippetPackReader(packPath));
+    }
+    return packReader->isOpen() ? packReader.get() : nullptr;
+}
+
+bool DataPathGenerator::readOutput(const std::string& name, cv::Mat& snippet, std::string& text) const {
+    // Every snippet of the output is in the catalog : an unknown name is not looked for
+    SnippetInfo info;
+    bool cataloged = catalog && catalog->findByName(name, info);
+    if (catalog && !cataloged) {
+        return false;
+    }
+
+    std::ostringstream txt;
+    if (const SnippetPackReader* pack = getPackReader()) {
+        // The index of the pack gives the position of the snippet
+        size_t index;
+        if (!pack->findByName(name, index)) {
+            return false;
+        }
+        snippet = pack->decode(index);
+        pack->getEntries()[index].info.writeText(txt);
+        text = txt.str();
+        return snippet.data != nullptr;
+    }
+
+    // The snippet is in its own files
+    std::string path = outputDirectory + "/" + name;
+    snippet = cv::imread(path + ".png");
+
+    if (cataloged) {
+        // The metadata was recorded in the catalog
+        info.writeText(txt);
+    } else if (const SnippetManifestIndex* index = getManifestIndex()) {
+        // The metadata is in the manifest
+        const SnippetInfo* found = index->findByName(name);
+        if (found) {
+            found->writeText(txt);
+        }
+    } else {
+        std::ifstream readFile(path + ".txt");
+        txt << readFile.rdbuf();
+    }
+    text = txt.str();
+
+    return snippet.data != nullptr;
+}
+
+void DataPathGenerator::setManifestPath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(idMutex);
+    manifestPath = path;
+    manifestIndex.reset();
+}
+
+const SnippetManifestIndex* DataPathGenerator::getManifestIndex() const {
+    std::lock_guard<std::mutex> lock(idMutex);
+    if (manifestPath.empty()) {
+        return nullptr;
+    }
+    if (!manifestIndex) {
+        std::vector<SnippetInfo> infos;
+        if (!SnippetManifest::load(manifestPath, infos)) {
+            std::cerr << "Could not read the manifest: " << manifestPath << std::endl;
+        }
+        manifestIndex.reset(new SnippetManifestIndex(std::move(infos)));
+    }
+    return manifestIndex.get();
+}
+
+void DataPathGenerator::setCatalog(const SnippetCatalog* snippetCatalog) {
+    std::lock_guard<std::mutex> lock(idMutex);
+    catalog = snippetCatalog;
+}
@@ -0,0 +1,66 @@
+#include "utility/FormLayout.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+bool FormLayout::load(const std::string& path, FormLayout& layout) {
+    std::ifstream readFile(path);
+    if (!readFile) {
+        return false;
+    }
+
+    FormLayout res;
+    std::string line;
+    while (getline(readFile, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key) || key[0] == '#') {
+            continue;
+        }
+
+        bool valid;
+        if (key == "page") valid = bool(fields >> res.pageSize.width >> res.pageSize.height);
+        else if (key == "origin") valid = bool(fields >> res.origin.x >> res.origin.y);
+        else if (key == "right") valid = bool(fields >> res.pitchRight.x >> res.pitchRight.y);
+        else if (key == "bottom") valid = bool(fields >> res.pitchBottom.x >> res.pitchBottom.y);
+        else if (key == "grid") valid = bool(fields >> res.rows >> res.columns);
+        else if (key == "snippet") valid = bool(fields >> res.snippetSide);
+        else if (key == "icon") valid = bool(fields >> res.iconOffset);
+        else if (key == "reference") valid = bool(fields >> res.referenceShift);
+        else if (key == "id") valid = bool(fields >> res.idRowShift);
+        else valid = false;
+
+        if (!valid) {
+            std::cerr << "Invalid line in the layout " << path << ": " << line << std::endl;
+            return false;
+        }
+    }
+
+    if (!res.hasGrid() || res.pageSize.area() == 0) {
+        std::cerr << "Incomplete layout: " << path << std::endl;
+        return false;
+    }
+    layout = res;
+    return true;
+}
+
+bool FormLayout::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cerr << "Could not create the layout: " << path << std::endl;
+        return false;
+    }
+
+    file << "# Layout of the forms, in pixels of a page of the given size" << '\n'
+         << "page " << pageSize.width << ' ' << pageSize.height << '\n'
+         << "origin " << origin.x << ' ' << origin.y << '\n'
+         << "right " << pitchRight.x << ' ' << pitchRight.y << '\n'
+         << "bottom " << pitchBottom.x << ' ' << pitchBottom.y << '\n'
+         << "grid " << rows << ' ' << columns << '\n'
+         << "snippet " << snippetSide << '\n'
+         << "icon " << iconOffset << '\n'
+         << "reference " << referenceShift << '\n'
+         << "id " << idRowShift << '\n';
+    return bool(file);
+}
@@ -0,0 +1,219 @@
+#include "utility/FormPipeline.hpp"
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include <opencv2/imgcodecs.hpp>
+
+FormPipeline::FormPipeline(const Config& config, const ImageRecognitionManager& imgManager,
+                           DataPathGenerator& generator, QualityChecker& checker) :
+        config(config), imgManager(imgManager), generator(generator), checker(checker) {}
+
+FormPipeline::Config FormPipeline::defaultConfig(unsigned int nbThreads) {
+    Config res;
+    res.decodeWorkers = std::max(1u, nbThreads / 8);
+    res.binarizeWorkers = std::max(1u, nbThreads / 8);
+    res.gridWorkers = std::max(1u, nbThreads / 16);
+    res.extractWorkers = std::max(1u, nbThreads / 8);
+    res.encodeWorkers = std::max(1u, nbThreads / 8);
+
+    // ORB is the most expensive stage : it gets all the remaining threads
+    unsigned int others = res.decodeWorkers + res.binarizeWorkers + res.gridWorkers + res.extractWorkers + res.encodeWorkers;
+    res.recognizeWorkers = nbThreads > others ? nbThreads - others : 1;
+
+    res.queueCapacity = std::max(2u, nbThreads);
+    return res;
+}
+
+void FormPipeline::run(const std::vector<std::string>& pathToImages) {
+    typedef bool (FormPipeline::*Stage)(FormJob&) const;
+    const std::vector<std::pair<Stage, unsigned int>> stages = {
+            {&FormPipeline::decode, config.decodeWorkers},
+            {&FormPipeline::binarize, config.binarizeWorkers},
+            {&FormPipeline::grid, config.gridWorkers},
+            {&FormPipeline::recognize, config.recognizeWorkers},
+            {&FormPipeline::extract, config.extractWorkers},
+            {&FormPipeline::encode, config.encodeWorkers}
+    };
+
+    // The queue i is the input of the stage i
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    // Number of workers still running in each stage
+    std::vector<std::unique_ptr<std::atomic<unsigned int>>> running;
+    for (const auto& stage : stages) {
+        queues.emplace_back(new JobQueue(config.queueCapacity));
+        running.emplace_back(new std::atomic<unsigned int>(std::max(1u, stage.second)));
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < stages.size(); i++) {
+        for (unsigned int w = 0; w < std::max(1u, stages[i].second); w++) {
+            workers.emplace_back([this, i, &stages, &queues, &running] {
+                std::unique_ptr<FormJob> job;
+                while (queues[i]->pop(job)) {
+                    // A form is dropped when a stage fails, and freed after the last one
+                    if ((this->*stages[i].first)(*job) && i + 1 < stages.size()) {
+                        queues[i + 1]->push(std::move(job));
+                    }
+                    job.reset();
+                }
+
+                // The last worker of a stage tells the next one that nothing will come anymore
+                if (--(*running[i]) == 0 && i + 1 < stages.size()) {
+                    queues[i + 1]->close();
+                }
+            });
+        }
+    }
+
+    // Feed the first stage
+    for (const std::string& path : pathToImages) {
+        std::unique_ptr<FormJob> job(new FormJob());
+        job->path = path;
+        queues[0]->push(std::move(job));
+    }
+    queues[0]->close();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+std::unique_ptr<SnippetExtractor> FormPipeline::acquireExtractor() const {
+    std::lock_guard<std::mutex> lock(freeMutex);
+    if (freeExtractors.empty()) {
+        return std::unique_ptr<SnippetExtractor>(new SnippetExtractor());
+    }
+    std::unique_ptr<SnippetExtractor> res = std::move(freeExtractors.back());
+    freeExtractors.pop_back();
+    return res;
+}
+
+void FormPipeline::releaseExtractor(FormJob& job) const {
+    std::lock_guard<std::mutex> lock(freeMutex);
+    freeExtractors.push_back(std::move(job.extractor));
+}
+
+bool FormPipeline::decode(FormJob& job) const {
+    // Open the current image and put it in a matrix
+    job.image = cv::imread(job.path);
+    if (job.image.data == nullptr) {
+        std::cerr << "Image not found: " << job.path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FormPipeline::binarize(FormJob& job) const {
+    // Set the image on which we extract the informations
+    job.extractor = acquireExtractor();
+    job.extractor->setExtractionMode(config.extractionMode);
+    job.extractor->setDetectionScale(config.detectionScale);
+    job.extractor->setDetectionBackend(config.detectionBackend);
+    job.extractor->setLayout(config.layout);
+    job.extractor->setSink(config.sink);
+    job.extractor->setCatalog(config.catalog);
+    job.extractor->binarize(std::move(job.image));
+    return true;
+}
+
+bool FormPipeline::grid(FormJob& job) const {
+    // Skip images with no snippets
+    if (!job.extractor->detectGrid()) {
+        std::cout << "Skipped : " << job.path << std::endl;
+        if (config.journal) {
+            config.journal->markDone(job.path, std::vector<SnippetInfo>());
+        }
+        releaseExtractor(job);
+        return false;
+    }
+
+    // Get the ID of the form from its path
+    for (char c : job.path) {
+        if (isdigit(c)) job.formIdText += c;
+    }
+
+    // Add it to the idToPath map
+    generator.putPathWithId(job.formIdText, job.path);
+
+    // Extract the reference label (and size if present)
+    job.extractor->getReferences(job.extractor->getImage(), job.references);
+    return true;
+}
+
+bool FormPipeline::recognize(FormJob& job) const {
+    const std::string page = job.formIdText.substr(2, 4);
+    for (int j = 0; j < job.references.size(); j++) {
+        const cv::Mat& reference = job.references[j];
+
+        // The rows already learned on this page are only verified
+        std::pair<std::string, std::string> rowLabelSize;
+        if (!config.recognitionCache || !config.recognitionCache->lookup(page, j, reference, rowLabelSize)) {
+            // A reference close to an already recognized one gets its result
+            // (a weak hit, with a few different bits, is recognized again)
+            uint64_t hash = config.hashCache ? ReferenceHashCache::getHash(reference) : 0;
+            double confidence;
+            if (!config.hashCache || !config.hashCache->lookup(hash, rowLabelSize, confidence) ||
+                confidence < ReferenceHashCache::minConfidence) {
+                // Recognize the reference label + size using the image recognition manager
+                ImageRecognitionManager::Features rowFeatures = imgManager.computeFeatures(reference);
+                rowLabelSize = imgManager.imageRecognitionAlgorithm(rowFeatures);
+                if (config.hashCache) {
+                    config.hashCache->record(hash, rowLabelSize);
+                }
+            }
+            if (config.recognitionCache) {
+                config.recognitionCache->record(page, j, reference, rowLabelSize);
+            }
+        }
+
+        // Counting labels in the quality checker
+        if (!rowLabelSize.first.empty())
+            checker.putLabel(rowLabelSize.first);
+
+        job.rowLabelSizes.push_back(rowLabelSize);
+    }
+    return true;
+}
+
+bool FormPipeline::extract(FormJob& job) const {
+    job.rowSnippets.resize(job.rowLabelSizes.size());
+    for (uint j = 0; j < job.rowLabelSizes.size(); j++) {
+        // Crop the snippets on the rows with a label
+        if (!job.rowLabelSizes[j].first.empty())
+            job.extractor->cropRow(j, job.rowSnippets[j]);
+    }
+
+    // The references are not needed anymore
+    job.references.clear();
+    return true;
+}
+
+bool FormPipeline::encode(FormJob& job) const {
+    for (uint j = 0; j < job.rowSnippets.size(); j++) {
+        // Save the snippets with the given label + size
+        if (!job.rowLabelSizes[j].first.empty())
+            job.extractor->saveRow(j, job.rowSnippets[j], job.rowLabelSizes[j].first, job.rowLabelSizes[j].second,
+                                   job.formIdText.substr(0, 2), job.formIdText.substr(2, 4));
+    }
+
+    // The form is completed once its snippets are saved
+    if (config.journal && config.catalog) {
+        RunJournal* journal = config.journal;
+        std::string path = job.path;
+        std::vector<SnippetInfo> snippets = config.catalog->getForm(job.formIdText.substr(0, 6));
+        std::function<void()> done = [journal, path, snippets] { journal->markDone(path, snippets); };
+        if (config.sink) {
+            config.sink->whenSaved(done);
+        } else {
+            done();
+        }
+    }
+
+    // The next form can use its buffers
+    releaseExtractor(job);
+    return true;
+}
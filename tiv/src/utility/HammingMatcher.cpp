@@ -0,0 +1,238 @@
+#include "utility/HammingMatcher.hpp"
+
+#include <iostream>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAMMING_MATCHER_X86
+#endif
+
+// An ORB descriptor is 32 bytes long, that is 4 words of 64 bits
+const int HammingMatcher::descriptorBytes = 32;
+
+namespace {
+
+    /**
+     * Signature of a kernel finding the 2 nearest neighbors of one query descriptor among n train descriptors
+     */
+    typedef void (*NearestKernel)(const uchar* query, const uchar* train, int n,
+                                  int& best, int& bestIdx, int& second);
+
+    // Word k of a descriptor (the descriptors are stored as bytes : the words are copied, not aliased)
+    inline uint64_t word(const uchar* descriptor, int k) {
+        uint64_t res;
+        std::memcpy(&res, descriptor + k * sizeof(uint64_t), sizeof(uint64_t));
+        return res;
+    }
+
+    // Hamming distance between two descriptors
+    inline int distance(const uchar* query, const uchar* train) {
+        return __builtin_popcountll(word(query, 0) ^ word(train, 0)) +
+               __builtin_popcountll(word(query, 1) ^ word(train, 1)) +
+               __builtin_popcountll(word(query, 2) ^ word(train, 2)) +
+               __builtin_popcountll(word(query, 3) ^ word(train, 3));
+    }
+
+    // Keeps the 2 smallest distances (ties are resolved like cv::BFMatcher : first index wins)
+    inline void keepNearest(int dist, int i, int& best, int& bestIdx, int& second) {
+        if (dist < best) {
+            second = best;
+            best = dist;
+            bestIdx = i;
+        } else if (dist < second) {
+            second = dist;
+        }
+    }
+
+    void nearestScalar(const uchar* query, const uchar* train, int n,
+                       int& best, int& bestIdx, int& second) {
+        for (int i = 0; i < n; i++, train += 32) {
+            keepNearest(distance(query, train), i, best, bestIdx, second);
+        }
+    }
+
+#ifdef HAMMING_MATCHER_X86
+
+    // Same as the scalar kernel, but compiled with the hardware popcnt instruction
+    __attribute__((target("popcnt")))
+    void nearestPopcnt(const uchar* query, const uchar* train, int n,
+                       int& best, int& bestIdx, int& second) {
+        for (int i = 0; i < n; i++, train += 32) {
+            keepNearest(distance(query, train), i, best, bestIdx, second);
+        }
+    }
+
+    // Whole descriptor in one register, popcount of each byte with a nibble lookup table (Mula's algorithm)
+    __attribute__((target("avx2")))
+    void nearestAVX2(const uchar* query, const uchar* train, int n,
+                     int& best, int& bestIdx, int& second) {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowMask = _mm256_set1_epi8(0x0f);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query));
+
+        for (int i = 0; i < n; i++, train += 32) {
+            __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(train)));
+            __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowMask));
+            __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask));
+            // Sum of the bytes counts in each 64 bits lane
+            __m256i sums = _mm256_sad_epu8(_mm256_add_epi8(low, high), zero);
+            __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+            int dist = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+            keepNearest(dist, i, best, bestIdx, second);
+        }
+    }
+
+    // Native 64 bits popcount on the 4 lanes of the descriptor
+    __attribute__((target("avx512f,avx512vl,avx512vpopcntdq")))
+    void nearestAVX512(const uchar* query, const uchar* train, int n,
+                       int& best, int& bestIdx, int& second) {
+        const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query));
+
+        for (int i = 0; i < n; i++, train += 32) {
+            __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(train)));
+            __m256i counts = _mm256_popcnt_epi64(x);
+            __m128i s = _mm_add_epi64(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+            int dist = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+            keepNearest(dist, i, best, bestIdx, second);
+        }
+    }
+
+#endif
+
+    /**
+     * Chooses the best kernel for the current CPU
+     */
+    NearestKernel selectKernel(const char*& name) {
+#ifdef HAMMING_MATCHER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512vl")) {
+            name = "AVX-512 VPOPCNTDQ";
+            return nearestAVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            name = "AVX2";
+            return nearestAVX2;
+        }
+        if (__builtin_cpu_supports("popcnt")) {
+            name = "popcnt";
+            return nearestPopcnt;
+        }
+#endif
+        name = "scalar";
+        return nearestScalar;
+    }
+
+    // The kernel is selected once, when the program starts
+    const char* kernelName = nullptr;
+    const NearestKernel nearestKernel = selectKernel(kernelName);
+
+}
+
+const char* HammingMatcher::getKernelName() {
+    return kernelName;
+}
+
+const uchar* HammingMatcher::getDescriptors(const cv::Mat& src, std::vector<uchar>& buffer) {
+    if (src.empty()) {
+        return nullptr;
+    }
+
+    // Error management
+    if (src.type() != CV_8U || src.cols != descriptorBytes) {
+        std::cerr << "Wrong descriptors type - HammingMatcher expects 32 bytes ORB descriptors" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // The descriptors computed by ORB are contiguous : the kernels read them in place
+    if (src.isContinuous()) {
+        return src.data;
+    }
+
+    buffer.resize(src.rows * descriptorBytes);
+    for (int i = 0; i < src.rows; i++) {
+        const uchar* row = src.ptr<uchar>(i);
+        std::copy(row, row + descriptorBytes, &buffer[i * descriptorBytes]);
+    }
+    return buffer.data();
+}
+
+void HammingMatcher::add(const cv::Mat& trainDescriptors) {
+    std::vector<uchar> buffer;
+    const uchar* train = getDescriptors(trainDescriptors, buffer);
+
+    firstOfImage.push_back(descriptors.size() / descriptorBytes);
+    if (train) {
+        descriptors.insert(descriptors.end(), train, train + trainDescriptors.rows * descriptorBytes);
+    }
+}
+
+void HammingMatcher::ratioMatch(const cv::Mat& queryDescriptors, float ratio,
+                                std::vector<cv::DMatch>& good_matches) const {
+    std::vector<int> images(firstOfImage.size());
+    for (size_t image = 0; image < images.size(); image++) {
+        images[image] = image;
+    }
+    ratioMatch(queryDescriptors, images, ratio, good_matches);
+}
+
+void HammingMatcher::ratioMatch(const cv::Mat& queryDescriptors, const std::vector<int>& images, float ratio,
+                                std::vector<cv::DMatch>& good_matches) const {
+    std::vector<uchar> buffer;
+    const uchar* query = getDescriptors(queryDescriptors, buffer);
+    int nQuery = query ? queryDescriptors.rows : 0;
+
+    for (int i = 0; i < nQuery; i++) {
+        // The 2 nearest neighbors are searched in each image : the images do not compete in the Lowe's test
+        for (int image : images) {
+            int first = firstOfImage[image];
+            int nTrain = imageEnd(image) - first;
+
+            // The Lowe's test needs the two nearest neighbors
+            if (nTrain < 2) {
+                continue;
+            }
+
+            int best = std::numeric_limits<int>::max();
+            int second = std::numeric_limits<int>::max();
+            int bestIdx = -1;
+            nearestKernel(query + i * descriptorBytes, descriptors.data() + first * descriptorBytes, nTrain,
+                          best, bestIdx, second);
+
+            // Lowe's ratio test, done directly on the 2 nearest neighbors
+            if (best < ratio * second) {
+                good_matches.emplace_back(i, bestIdx, image, (float) best);
+            }
+        }
+    }
+}
+
+void HammingMatcher::ratioMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                                float ratio, std::vector<cv::DMatch>& good_matches) {
+    std::vector<uchar> queryBuffer, trainBuffer;
+    const uchar* query = getDescriptors(queryDescriptors, queryBuffer);
+    const uchar* train = getDescriptors(trainDescriptors, trainBuffer);
+    int nQuery = query ? queryDescriptors.rows : 0;
+    int nTrain = train ? trainDescriptors.rows : 0;
+
+    // The Lowe's test needs the two nearest neighbors
+    if (nTrain < 2) {
+        return;
+    }
+
+    for (int i = 0; i < nQuery; i++) {
+        int best = std::numeric_limits<int>::max();
+        int second = std::numeric_limits<int>::max();
+        int bestIdx = -1;
+        nearestKernel(query + i * descriptorBytes, train, nTrain, best, bestIdx, second);
+
+        // Lowe's ratio test, done directly on the 2 nearest neighbors
+        if (best < ratio * second) {
+            good_matches.emplace_back(i, bestIdx, 0, (float) best);
+        }
+    }
+}
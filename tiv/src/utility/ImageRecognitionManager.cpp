@@ -13,6 +13,7 @@
 
 #include "utility/ImageRecognitionManager.hpp"
 #include "utility/SnippetExtractor.hpp"
+#include "utility/HammingMatcher.hpp"
 
 #define PI 3.14159265
 
@@ -24,6 +25,8 @@ const std::vector<std::string> ImageRecognitionManager::labels =
 
 const std::vector<std::string> ImageRecognitionManager::sizes = {"large", "medium", "small"};
 
+const float ImageRecognitionManager::loweRatio = 0.75f;
+
 void ImageRecognitionManager::initImg(const std::string& img) {
     // Loading image into the base of matrix (only done once)
     std::string path = "../base2/" + img + ".png";
@@ -35,12 +38,18 @@ void ImageRecognitionManager::initImg(const std::string& img) {
         exit(EXIT_FAILURE);
     }
 
+    // The references never change during a run, so their features are computed once here
+    Features features;
+    ORBFeaturesDetection(tempMatrix, features);
+
     if (std::find(labels.begin(), labels.end(), img) != labels.end()) {
-        // Adding the matrix to the baseLabels map
+        // Adding the matrix and its features to the label maps
         baseLabels.emplace(img, tempMatrix);
+        featuresLabels.emplace(img, features);
     } else if (std::find(sizes.begin(), sizes.end(), img) != sizes.end()) {
-        // Adding the matrix to the baseSizes map
+        // Adding the matrix and its features to the size maps
         baseSizes.emplace(img, tempMatrix);
+        featuresSizes.emplace(img, features);
     } else {
         std::cerr << "Wrong image name"<< path << std::endl;
         exit(EXIT_FAILURE);
@@ -48,68 +57,180 @@ void ImageRecognitionManager::initImg(const std::string& img) {
 
 }
 
-ImageRecognitionManager::ImageRecognitionManager() {
+ImageRecognitionManager::ImageRecognitionManager() : prefilter(Prefilter::None), topK(0), fastSize(false) {
     for (const std::string& label : labels) {
         initImg(label);
     }
     for (const std::string& size : sizes) {
         initImg(size);
     }
+    initLabelMatcher();
 }
 
-void ImageRecognitionManager::ORBFeaturesDetection(const cv::Mat& referenceImg,
-                      const cv::Mat& processImg,
-                      std::vector<cv::KeyPoint>& keypoints_object,
-                      std::vector<cv::KeyPoint>& keypoints_scene,
-                      cv::Mat& descriptors_object,
-                      cv::Mat& descriptors_scene) const {
-    cv::Ptr<cv::ORB> detector = cv::ORB::create(2000);
-    detector->detectAndCompute(referenceImg, cv::noArray(), keypoints_object, descriptors_object);
-    detector->detectAndCompute(processImg, cv::noArray(), keypoints_scene, descriptors_scene);
+void ImageRecognitionManager::initLabelMatcher() {
+    // One train image per label, in the order of labels : the imgIdx of a match is the index of its label
+    for (const std::string& label : labels) {
+        labelMatcher.add(featuresLabels.at(label).descriptors);
+    }
 }
 
-void ImageRecognitionManager::loweTestFilter(const std::vector<std::vector<cv::DMatch>>& knn_matches,
-                                             std::vector<cv::DMatch>& good_matches) const {
-    const float ratio_thresh = 0.75f;
-    for (size_t i = 0; i < knn_matches.size(); i++) {
-        if (knn_matches[i][0].distance < ratio_thresh * knn_matches[i][1].distance) {
-            good_matches.push_back(knn_matches[i][0]);
+void ImageRecognitionManager::setCascade(Prefilter prefilter, int topK) {
+    this->prefilter = topK > 0 && topK < (int) labels.size() ? prefilter : Prefilter::None;
+    this->topK = topK;
+
+    // The global descriptors of the references are computed once
+    prefilterLabels.clear();
+    if (this->prefilter != Prefilter::None) {
+        for (const std::string& label : labels) {
+            prefilterLabels.push_back(computePrefilter(baseLabels.at(label), this->prefilter));
         }
     }
 }
 
-std::pair<double, double> ImageRecognitionManager::getRatioRotation(const cv::Mat& processImg, const cv::Mat& referenceImg, bool isLabel) const {
+bool ImageRecognitionManager::setFastSizeDetection(bool enabled) {
+    fastSize = false;
+    if (!enabled) {
+        return false;
+    }
+
+    // The patches of the sizes are only built when the classifier is used
+    SizeClassifier classifier;
+    for (const std::string& size : sizes) {
+        if (!classifier.addSize(size, baseSizes.at(size))) {
+            std::cerr << "The sizes are recognized with ORB" << std::endl;
+            return false;
+        }
+    }
+    sizeClassifier = classifier;
+    fastSize = true;
+    return true;
+}
 
-    //-- Step 1 : Detect the keypoints using ORB Detector and compute the descriptors
-    std::vector<cv::KeyPoint> keypoints_object, keypoints_scene;
-    cv::Mat descriptors_object, descriptors_scene;
-    ORBFeaturesDetection(referenceImg, processImg, keypoints_object, keypoints_scene, descriptors_object, descriptors_scene);
+cv::Mat ImageRecognitionManager::computePrefilter(const cv::Mat& img, Prefilter prefilter) {
+    // Gray thumbnail of a fixed size
+    const int side = 32, cells = 4, bins = 8;
+    cv::Mat gray, small, thumbnail;
+    if (img.channels() == 3) {
+        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = img;
+    }
+    cv::resize(gray, small, cv::Size(side, side), 0, 0, cv::INTER_AREA);
+    small.convertTo(thumbnail, CV_32F);
 
-    //-- Step 2 : Match the descriptor vectors with a Brute-Force Hamming based matcher
-    cv::Ptr<cv::DescriptorMatcher> matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::BRUTEFORCE_HAMMING);
-    std::vector<std::vector<cv::DMatch>> knn_matches;
-    matcher->knnMatch(descriptors_object, descriptors_scene, knn_matches, 2);
+    cv::Mat res;
+    if (prefilter == Prefilter::Correlation) {
+        // Zero mean : the dot product of two unit thumbnails is their correlation
+        res = thumbnail.reshape(1, 1) - cv::mean(thumbnail)[0];
+    } else {
+        // Orientations (modulo 180 degrees) weighted by the magnitude of the gradient, in each cell
+        cv::Mat dx, dy, magnitude, angle;
+        cv::Sobel(thumbnail, dx, CV_32F, 1, 0);
+        cv::Sobel(thumbnail, dy, CV_32F, 0, 1);
+        cv::cartToPolar(dx, dy, magnitude, angle, true);
+
+        res = cv::Mat::zeros(1, cells * cells * bins, CV_32F);
+        float* histogram = res.ptr<float>(0);
+        const int cellSide = side / cells;
+        for (int y = 0; y < side; y++) {
+            const float* m = magnitude.ptr<float>(y);
+            const float* a = angle.ptr<float>(y);
+            for (int x = 0; x < side; x++) {
+                int bin = std::min(bins - 1, (int) (std::fmod(a[x], 180.f) * bins / 180));
+                histogram[((y / cellSide) * cells + x / cellSide) * bins + bin] += m[x];
+            }
+        }
+    }
+
+    double norm = cv::norm(res);
+    if (norm > 0) {
+        res /= norm;
+    }
+    return res;
+}
+
+std::vector<int> ImageRecognitionManager::getCandidateLabels(const Features& processFeatures) const {
+    std::vector<std::pair<double, int>> scores;
+    for (size_t i = 0; i < labels.size(); i++) {
+        scores.emplace_back(processFeatures.prefilter.dot(prefilterLabels[i]), i);
+    }
+
+    // The best scores first (ties keep the order of labels)
+    std::partial_sort(scores.begin(), scores.begin() + topK, scores.end(),
+                      [] (const std::pair<double, int>& s1, const std::pair<double, int>& s2) {
+                          return s1.first > s2.first || (s1.first == s2.first && s1.second < s2.second);
+                      });
+
+    std::vector<int> res;
+    for (int i = 0; i < topK; i++) {
+        res.push_back(scores[i].second);
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+void ImageRecognitionManager::ORBFeaturesDetection(const cv::Mat& img, Features& features) const {
+    cv::Ptr<cv::ORB> detector = cv::ORB::create(2000);
+    detector->detectAndCompute(img, cv::noArray(), features.keypoints, features.descriptors);
+}
 
+ImageRecognitionManager::Features ImageRecognitionManager::computeFeatures(const cv::Mat& processImg) const {
+    Features features;
+    ORBFeaturesDetection(processImg, features);
+    if (prefilter != Prefilter::None) {
+        features.prefilter = computePrefilter(processImg, prefilter);
+    }
+    if (fastSize) {
+        features.sizePatch = SizeClassifier::computePatch(processImg);
+    }
+    return features;
+}
+
+std::pair<double, double> ImageRecognitionManager::getRatioRotation(const Features& processFeatures, const Features& reference, bool isLabel) const {
+
+    //-- Step 1 : Get the keypoints and the descriptors computed by ORB
+    // (the reference ones were computed in the constructor, the processed ones once per image)
+    const std::vector<cv::KeyPoint>& keypoints_object = reference.keypoints;
+    const std::vector<cv::KeyPoint>& keypoints_scene = processFeatures.keypoints;
+    const cv::Mat& descriptors_object = reference.descriptors;
+    const cv::Mat& descriptors_scene = processFeatures.descriptors;
+
+    //-- Step 2 : Match the descriptor vectors with a Brute-Force Hamming based matcher
     //-- Step 3 : Filter knn matches using the Lowe's ratio test (keeps only the best matches)
+    // Both are done in a single pass by the Hamming matcher
     std::vector<cv::DMatch> good_matches;
-    loweTestFilter(knn_matches, good_matches);
+    HammingMatcher::ratioMatch(descriptors_object, descriptors_scene, loweRatio, good_matches);
 
-    //-- Step 4 : Compute the ratio of the good matches among all matches
-    double ratio = ((double) good_matches.size() / (double) knn_matches.size()) * 100;
+    //-- Step 4 : Compute the ratio of the good matches among all matches (one knn match per reference descriptor)
+    double ratio = ((double) good_matches.size() / (double) descriptors_object.rows) * 100;
 
     //-- Step 5 : Compute the rotation between the reference and the processed images
     double rotation = 90;
 
-    // Need a minimum number of good matches to find the homography matrix
     // No need to compute it on sizes
-    if (isLabel && good_matches.size() > 4) {
+    if (isLabel) {
+        rotation = getRotation(good_matches, keypoints_object, keypoints_scene, false);
+    }
+    return std::make_pair(ratio, rotation);
+}
+
+double ImageRecognitionManager::getRotation(const std::vector<cv::DMatch>& good_matches,
+                                            const std::vector<cv::KeyPoint>& keypoints_object,
+                                            const std::vector<cv::KeyPoint>& keypoints_scene,
+                                            bool isSceneQuery) const {
+    double rotation = 90;
+
+    // Need a minimum number of good matches to find the homography matrix
+    if (good_matches.size() > 4) {
         // Localize the object
         std::vector<cv::Point2f> obj;
         std::vector<cv::Point2f> scene;
         for (size_t i = 0; i < good_matches.size(); i++) {
             // Get the keypoints from the good matches
-            obj.push_back(keypoints_object[good_matches[i].queryIdx].pt);
-            scene.push_back(keypoints_scene[good_matches[i].trainIdx].pt);
+            int objectIdx = isSceneQuery ? good_matches[i].trainIdx : good_matches[i].queryIdx;
+            int sceneIdx = isSceneQuery ? good_matches[i].queryIdx : good_matches[i].trainIdx;
+            obj.push_back(keypoints_object[objectIdx].pt);
+            scene.push_back(keypoints_scene[sceneIdx].pt);
         }
         // Find the homography matrix
         cv::Mat H = findHomography(obj, scene, cv::RANSAC);
@@ -127,10 +248,41 @@ std::pair<double, double> ImageRecognitionManager::getRatioRotation(const cv::Ma
             rotation = atan2(H.at<double>(1,0), H.at<double>(0,0)) * 180 / PI;
         }
     }
-    return std::make_pair(ratio, abs(rotation));
+    return std::abs(rotation);
+}
+
+void ImageRecognitionManager::getLabelMatches(const Features& processFeatures,
+                                              std::vector<std::vector<cv::DMatch>>& matchesPerLabel) const {
+    matchesPerLabel.assign(labels.size(), std::vector<cv::DMatch>());
+
+    // Nothing to match if ORB found no keypoint on the image to process
+    if (processFeatures.descriptors.empty()) {
+        return;
+    }
+
+    //-- Step 1 : A single knn query of the processed descriptors against the index of all the labels
+    // (or only of the labels ranked first by the cascade : the others get no match, so no homography)
+    //-- Step 2 : Filter knn matches using the Lowe's ratio test (done in the same pass, with the 2 nearest
+    // neighbors within each label : a stroke shared by two labels is a vote for both, as with one matcher per label)
+    std::vector<cv::DMatch> good_matches;
+    if (prefilter != Prefilter::None && !processFeatures.prefilter.empty()) {
+        labelMatcher.ratioMatch(processFeatures.descriptors, getCandidateLabels(processFeatures), loweRatio, good_matches);
+    } else {
+        labelMatcher.ratioMatch(processFeatures.descriptors, loweRatio, good_matches);
+    }
+
+    //-- Step 3 : Each good match is a vote for the label of the reference it was found in
+    for (const cv::DMatch& match : good_matches) {
+        matchesPerLabel[match.imgIdx].push_back(match);
+    }
 }
 
 std::pair<std::string, std::string> ImageRecognitionManager::imageRecognitionAlgorithm(const cv::Mat& processImg) const {
+    // The image to process is featurized once, then compared to every reference
+    return imageRecognitionAlgorithm(computeFeatures(processImg));
+}
+
+std::pair<std::string, std::string> ImageRecognitionManager::imageRecognitionAlgorithm(const Features& processFeatures) const {
     // Label comparators
     double ratioMaxLabel = 0;
     double rotationMinLabel = 90;
@@ -139,18 +291,21 @@ std::pair<std::string, std::string> ImageRecognitionManager::imageRecognitionAlg
     double ratioMaxSize = 0;
     std::string sizeMax;
 
-    cv::Mat referenceImg;
+    //-- Step 0 : Match the image to process against all the labels at once
+    std::vector<std::vector<cv::DMatch>> matchesPerLabel;
+    getLabelMatches(processFeatures, matchesPerLabel);
+    double nbDescriptors = processFeatures.descriptors.rows;
 
-    for (const std::string& label : labels) {
+    for (size_t i = 0; i < labels.size(); i++) {
+        const std::string& label = labels[i];
 
-        //-- Step 1 : Define the reference image (one of the 14 base images) to compare to the image to process
-        referenceImg = baseLabels.at(label);
+        //-- Step 1 : Get the votes of the image to process for this label (one of the 14 base images)
+        const std::vector<cv::DMatch>& good_matches = matchesPerLabel[i];
 
         //-- Step 2 : Compute the ratio of the good matches among all matches
         // + the rotation between the reference & the processed label image
-        std::pair<double, double> resRatioRotation = getRatioRotation(processImg, referenceImg, true);
-        double tempRatio = resRatioRotation.first;
-        double tempRotation = resRatioRotation.second;
+        double tempRatio = nbDescriptors > 0 ? ((double) good_matches.size() / nbDescriptors) * 100 : 0;
+        double tempRotation = getRotation(good_matches, featuresLabels.at(label).keypoints, processFeatures.keypoints, true);
 
         //-- Step 3 : Check if the result is better than the max
         if (tempRatio > ratioMaxLabel) {
@@ -164,13 +319,18 @@ std::pair<std::string, std::string> ImageRecognitionManager::imageRecognitionAlg
         }
     }
 
+    // The size word is compared to the size images directly (no size is an explicit outcome of the classifier)
+    if (fastSize) {
+        return std::make_pair(labelMax, sizeClassifier.classify(processFeatures.sizePatch));
+    }
+
     for (const std::string& size : sizes) {
 
-        //-- Step 1 : Define the reference image (one of the 3 base images) to compare to the image to process
-        referenceImg = baseSizes.at(size);
+        //-- Step 1 : Define the reference features (one of the 3 base images) to compare to the image to process
+        const Features& reference = featuresSizes.at(size);
 
         //-- Step 2 : Compute the ratio of the good matches among all matches
-        std::pair<double, double> resRatioRotation = getRatioRotation(processImg, referenceImg, false);
+        std::pair<double, double> resRatioRotation = getRatioRotation(processFeatures, reference, false);
         double tempRatio = resRatioRotation.first;
 
         //-- Step 3 : Check if the result is better than the max and if so, stores the information
@@ -14,6 +14,7 @@
 #include "utility/QualityChecker.hpp"
 
 void QualityChecker::putLabel(const std::string& label) {
+    std::lock_guard<std::mutex> lock(countMutex);
     auto it = labelCount.find(label);
     if (it != labelCount.end()) {
        (*it).second += 1;
@@ -23,6 +24,7 @@ void QualityChecker::putLabel(const std::string& label) {
 }
 
 int QualityChecker::getLabelCount(const std::string& label) const {
+    std::lock_guard<std::mutex> lock(countMutex);
     int res = 0;
     auto it = labelCount.find(label);
     if (it != labelCount.end()) {
@@ -32,6 +34,7 @@ int QualityChecker::getLabelCount(const std::string& label) const {
 }
 
 int QualityChecker::getTotalLabels() const {
+    std::lock_guard<std::mutex> lock(countMutex);
     int sum = 0;
     for (const auto& elem : labelCount) {
         sum += elem.second;
@@ -50,16 +53,17 @@ void QualityChecker::randomCheck(const DataPathGenerator& generator, int loopLen
         std::pair<std::string, std::string> paths = generator.randomOutputPath();
 
         cv::Mat original, snippet;
+        std::string text;
         original = cv::imread(paths.first);
-        snippet = cv::imread("output/" + paths.second + ".png");
 
         if (original.data == nullptr) {
-            std::cerr << "Image not found: " << original << std::endl;
+            std::cerr << "Image not found: " << paths.first << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        if (snippet.data == nullptr) {
-            std::cerr << "Image not found: " << snippet << std::endl;
+        // The snippet is read from the output files or from the pack
+        if (!generator.readOutput(paths.second, snippet, text)) {
+            std::cerr << "Image not found: " << paths.second << std::endl;
             exit(EXIT_FAILURE);
         }
 
@@ -75,19 +79,8 @@ void QualityChecker::randomCheck(const DataPathGenerator& generator, int loopLen
         std::cout << std::endl;
         std::cout << "Verify the following text output file considering the original file and the snippet." << std::endl;
 
-        // we open the .txt file corresponding to the snippet
-        std::string textFile;
-        std::ifstream readFile("output/" + paths.second + ".txt");
-
-        // Use a while loop together with the getline() function to read the file line by line
-        while (getline(readFile, textFile)) {
-            // Output the text from the file
-            std::cout << textFile << std::endl;
-        }
-        std::cout << std::endl;
-
-        // Close the file
-        readFile.close();
+        // we output the text corresponding to the snippet
+        std::cout << text << std::endl;
 
         std::cout << "Is everything correct : label/size/id/row/colomn ? (y/n)" << std::endl;
 
@@ -0,0 +1,75 @@
+#include "utility/RecognitionCache.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+const int RecognitionCache::thumbnailSide = 32;
+
+const double RecognitionCache::minCorrelation = 0.9;
+
+RecognitionCache::RecognitionCache(int agreements) : agreements(std::max(1, agreements)), hits(0) {}
+
+cv::Mat RecognitionCache::getThumbnail(const cv::Mat& reference) {
+    cv::Mat gray, small, res;
+    if (reference.channels() == 3) {
+        cv::cvtColor(reference, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = reference;
+    }
+    cv::resize(gray, small, cv::Size(thumbnailSide, thumbnailSide), 0, 0, cv::INTER_AREA);
+    small.convertTo(res, CV_32F);
+
+    // Zero mean and unit norm : the dot product of two thumbnails is their correlation
+    res -= cv::mean(res)[0];
+    double norm = cv::norm(res);
+    if (norm > 0) {
+        res /= norm;
+    }
+    return res;
+}
+
+bool RecognitionCache::lookup(const std::string& page, int row, const cv::Mat& reference,
+                              std::pair<std::string, std::string>& labelSize) {
+    cv::Mat learned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(std::make_pair(page, row));
+        if (it == entries.end() || it->second.thumbnail.empty()) {
+            return false;
+        }
+        learned = it->second.thumbnail;
+        labelSize = it->second.labelSize;
+    }
+
+    // The reference must still look like the learned one (a different or badly cropped icon is recognized)
+    if (reference.empty() || getThumbnail(reference).dot(learned) < minCorrelation) {
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+void RecognitionCache::record(const std::string& page, int row, const cv::Mat& reference,
+                              const std::pair<std::string, std::string>& labelSize) {
+    if (labelSize.first.empty() || reference.empty()) {
+        return;
+    }
+    cv::Mat thumbnail = getThumbnail(reference);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[std::make_pair(page, row)];
+    if (entry.agreements > 0 && entry.labelSize == labelSize) {
+        entry.agreements++;
+    } else {
+        // A disagreement starts over : the row is not trusted anymore
+        entry.labelSize = labelSize;
+        entry.agreements = 1;
+        entry.thumbnail.release();
+    }
+
+    // The thumbnail of the last agreeing page is the one verified
+    if (entry.agreements >= agreements) {
+        entry.thumbnail = thumbnail;
+    }
+}
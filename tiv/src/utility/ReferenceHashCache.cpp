@@ -0,0 +1,96 @@
+#include "utility/ReferenceHashCache.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+const double ReferenceHashCache::minConfidence = 1 - 3 / 64.;
+
+ReferenceHashCache::ReferenceHashCache(int radius) :
+        radius(std::max(0, std::min(radius, 15))), hits(0), misses(0) {
+    // radius + 1 chunks covering the 64 bits
+    int nbChunks = this->radius + 1;
+    for (int i = 0; i < nbChunks; i++) {
+        int begin = i * 64 / nbChunks, end = (i + 1) * 64 / nbChunks;
+        shifts.push_back(begin);
+        masks.push_back(end - begin == 64 ? ~uint64_t(0) : (uint64_t(1) << (end - begin)) - 1);
+    }
+    chunkIndex.resize(nbChunks);
+}
+
+uint64_t ReferenceHashCache::getHash(const cv::Mat& reference) {
+    if (reference.empty()) {
+        return 0;
+    }
+    cv::Mat gray, small;
+    if (reference.channels() == 3) {
+        cv::cvtColor(reference, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = reference;
+    }
+    cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++) {
+        const uchar* row = small.ptr<uchar>(y);
+        for (int x = 0; x < 8; x++) {
+            hash = (hash << 1) | (row[x] < row[x + 1] ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+bool ReferenceHashCache::lookup(uint64_t hash, std::pair<std::string, std::string>& labelSize, double& confidence) {
+    int distance;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int index = findNearest(hash, distance);
+        if (index == -1) {
+            misses++;
+            return false;
+        }
+        labelSize = entries[index].labelSize;
+    }
+
+    confidence = 1 - distance / 64.;
+    hits++;
+    return true;
+}
+
+void ReferenceHashCache::record(uint64_t hash, const std::pair<std::string, std::string>& labelSize) {
+    if (labelSize.first.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Another worker may have recorded the same reference since the lookup
+    int distance;
+    if (findNearest(hash, distance) != -1) {
+        return;
+    }
+
+    size_t index = entries.size();
+    entries.push_back(Entry{hash, labelSize});
+    for (size_t i = 0; i < chunkIndex.size(); i++) {
+        chunkIndex[i][(hash >> shifts[i]) & masks[i]].push_back(index);
+    }
+}
+
+int ReferenceHashCache::findNearest(uint64_t hash, int& distance) const {
+    int res = -1;
+    distance = radius + 1;
+    for (size_t i = 0; i < chunkIndex.size(); i++) {
+        auto it = chunkIndex[i].find((hash >> shifts[i]) & masks[i]);
+        if (it == chunkIndex[i].end()) {
+            continue;
+        }
+        for (size_t index : it->second) {
+            int d = __builtin_popcountll(entries[index].hash ^ hash);
+            if (d < distance) {
+                distance = d;
+                res = index;
+            }
+        }
+    }
+    return res;
+}
@@ -0,0 +1,189 @@
+#include "utility/RunJournal.hpp"
+#include "utility/BinaryIO.hpp"
+
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace binaryio;
+
+namespace {
+
+    // Magic number at the beginning of the journal
+    const char journalMagic[8] = {'T', 'I', 'V', 'J', 'R', 'N', 'L', '1'};
+
+    // Marker at the end of each record
+    const char recordEnd[4] = {'D', 'O', 'N', 'E'};
+
+}
+
+const std::string RunJournal::pipelineVersion = "1";
+
+RunJournal::RunJournal(const std::string& path, const std::string& version) : path(path), version(version) {
+    load();
+    compact();
+}
+
+void RunJournal::compact() {
+    // Only the last record of each form is kept, written to a new file first
+    // so that the previous journal is still valid if the run stops now
+    if (file.is_open()) {
+        file.close();
+    }
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream tmp(tmpPath, std::ios::binary | std::ios::trunc);
+        tmp.write(journalMagic, sizeof(journalMagic));
+        for (const auto& form : done) {
+            writeRecord(tmp, form.first, form.second);
+        }
+        if (!tmp) {
+            std::cerr << "Could not create the journal: " << tmpPath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+
+    file.open(path, std::ios::binary | std::ios::app);
+    if (!file) {
+        std::cerr << "Could not open the journal: " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void RunJournal::load() {
+    std::ifstream readFile(path, std::ios::binary);
+    if (!readFile) {
+        return; // first run
+    }
+    std::vector<unsigned char> content((std::istreambuf_iterator<char>(readFile)), std::istreambuf_iterator<char>());
+
+    const unsigned char* cursor = content.data();
+    const unsigned char* end = cursor + content.size();
+    if (content.size() < sizeof(journalMagic) || std::memcmp(cursor, journalMagic, sizeof(journalMagic)) != 0) {
+        std::cerr << "Invalid journal, every form will be processed: " << path << std::endl;
+        return;
+    }
+    cursor += sizeof(journalMagic);
+
+    // The records are read until the end of the file, or until one was cut by a crash
+    while (cursor < end) {
+        std::string input;
+        Entry entry;
+        uint32_t count;
+        bool valid = readString(cursor, end, entry.version) && readString(cursor, end, input) &&
+                     readValue(cursor, end, entry.hash) && readValue(cursor, end, count);
+        for (uint32_t i = 0; valid && i < count; i++) {
+            SnippetInfo info;
+            valid = readInfo(cursor, end, info);
+            entry.snippets.push_back(info);
+        }
+        if (!valid || end - cursor < (std::ptrdiff_t) sizeof(recordEnd) ||
+            std::memcmp(cursor, recordEnd, sizeof(recordEnd)) != 0) {
+            std::cerr << "Incomplete record in the journal, its form will be processed again" << std::endl;
+            break;
+        }
+        cursor += sizeof(recordEnd);
+
+        // A form processed again replaces its previous record
+        done[input] = std::move(entry);
+    }
+}
+
+void RunJournal::writeRecord(std::ostream& out, const std::string& input, const Entry& entry) const {
+    writeString(out, entry.version);
+    writeString(out, input);
+    writeValue<uint64_t>(out, entry.hash);
+    writeValue<uint32_t>(out, entry.snippets.size());
+    for (const SnippetInfo& info : entry.snippets) {
+        writeInfo(out, info);
+    }
+    out.write(recordEnd, sizeof(recordEnd));
+}
+
+uint64_t RunJournal::hashFile(const std::string& path, bool& ok) {
+    std::ifstream readFile(path, std::ios::binary);
+    ok = bool(readFile);
+
+    uint64_t hash = 14695981039346656037ULL;
+    char buffer[1 << 16];
+    while (readFile) {
+        readFile.read(buffer, sizeof(buffer));
+        for (std::streamsize i = 0; i < readFile.gcount(); i++) {
+            hash = (hash ^ (unsigned char) buffer[i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+bool RunJournal::check(const std::string& input, std::vector<SnippetInfo>& snippets) {
+    // The file is hashed without the lock, several workers can read at the same time
+    bool ok;
+    uint64_t hash = hashFile(input, ok);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ok) {
+        return false; // the processing will report the error
+    }
+    hashes[input] = hash;
+
+    auto it = done.find(input);
+    if (it == done.end() || it->second.hash != hash || it->second.version != version) {
+        return false;
+    }
+    snippets = it->second.snippets;
+    return true;
+}
+
+bool RunJournal::getOutdated(const std::string& input, std::vector<SnippetInfo>& snippets) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = done.find(input);
+    if (it == done.end()) {
+        return false;
+    }
+    snippets = it->second.snippets;
+    return true;
+}
+
+void RunJournal::prune(const std::vector<std::string>& inputs, std::vector<SnippetInfo>& removed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::set<std::string> current(inputs.begin(), inputs.end());
+    bool changed = false;
+    for (auto it = done.begin(); it != done.end();) {
+        if (current.count(it->first) == 0) {
+            removed.insert(removed.end(), it->second.snippets.begin(), it->second.snippets.end());
+            it = done.erase(it);
+            changed = true;
+        } else {
+            it++;
+        }
+    }
+    if (changed) {
+        compact();
+    }
+}
+
+void RunJournal::markDone(const std::string& input, const std::vector<SnippetInfo>& snippets) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = hashes.find(input);
+    if (it == hashes.end()) {
+        return; // never checked : its content is unknown
+    }
+
+    Entry entry;
+    entry.version = version;
+    entry.hash = it->second;
+    entry.snippets = snippets;
+
+    // Flushed at once : the form stays completed if the run stops
+    writeRecord(file, input, entry);
+    file.flush();
+    done[input] = std::move(entry);
+}
+
+size_t RunJournal::getNumberDone() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return done.size();
+}
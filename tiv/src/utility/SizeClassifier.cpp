@@ -0,0 +1,127 @@
+#include "utility/SizeClassifier.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <opencv2/imgproc.hpp>
+
+const cv::Size SizeClassifier::patchSize(48, 12);
+
+const double SizeClassifier::minCorrelation = 0.5;
+
+const double SizeClassifier::maxAspectRatio = 1.4;
+
+namespace {
+
+    // Part of the image searched for the text line, from the bottom
+    const double bandHeight = 0.4;
+
+    // Minimal difference between the paper and the ink
+    const double minContrast = 64;
+
+    // Minimal number of ink pixels of a row of the text line, and empty rows allowed inside it (dot of the i)
+    const int minRowInk = 2;
+    const int maxGap = 2;
+
+    // A text line is wider than high
+    const double minAspect = 1.5;
+
+}
+
+bool SizeClassifier::addSize(const std::string& size, const cv::Mat& img) {
+    Patch patch = computePatch(img);
+
+    // Error management
+    if (patch.empty()) {
+        std::cerr << "No text line found on the size image - error in SizeClassifier: " << size << std::endl;
+        return false;
+    }
+    sizes.push_back(size);
+    patches.push_back(patch);
+    return true;
+}
+
+SizeClassifier::Patch SizeClassifier::computePatch(const cv::Mat& img) {
+    Patch res;
+    if (img.empty()) {
+        return res;
+    }
+
+    // Gray bottom band of the image
+    cv::Mat gray;
+    cv::Mat band = img.rowRange((int) (img.rows * (1 - bandHeight)), img.rows);
+    if (band.channels() == 3) {
+        cv::cvtColor(band, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = band;
+    }
+
+    // A blank band has no ink (Otsu would split the noise of the paper)
+    double minValue, maxValue;
+    cv::minMaxLoc(gray, &minValue, &maxValue);
+    if (maxValue - minValue < minContrast) {
+        return res;
+    }
+    cv::Mat ink;
+    cv::threshold(gray, ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+    // The lowest run of rows with ink is the text line
+    int bottom = ink.rows - 1;
+    while (bottom >= 0 && cv::countNonZero(ink.row(bottom)) < minRowInk) {
+        bottom--;
+    }
+    if (bottom < 0) {
+        return res;
+    }
+    int top = bottom, gap = 0;
+    for (int y = bottom - 1; y >= 0 && gap <= maxGap; y--) {
+        if (cv::countNonZero(ink.row(y)) >= minRowInk) {
+            top = y;
+            gap = 0;
+        } else {
+            gap++;
+        }
+    }
+
+    // Tight box of the ink of the text line
+    cv::Mat line = ink.rowRange(top, bottom + 1);
+    cv::Rect box = cv::boundingRect(line);
+    if (box.height < 3 || box.width < minAspect * box.height) {
+        return res;
+    }
+    res.aspect = (double) box.width / box.height;
+
+    // Fixed size patch, zero mean and unit norm : the dot product of two patches is their correlation
+    cv::Mat reduced;
+    cv::resize(line(box), reduced, patchSize, 0, 0, cv::INTER_AREA);
+    reduced.convertTo(res.pixels, CV_32F);
+    res.pixels -= cv::mean(res.pixels)[0];
+    double norm = cv::norm(res.pixels);
+    if (norm > 0) {
+        res.pixels /= norm;
+    }
+    return res;
+}
+
+std::string SizeClassifier::classify(const Patch& patch) const {
+    if (patch.empty()) {
+        return "";
+    }
+
+    double bestCorrelation = minCorrelation;
+    std::string res;
+    for (size_t i = 0; i < patches.size(); i++) {
+        // The words have different lengths : the aspect of the text line must be close
+        double aspectRatio = std::max(patch.aspect, patches[i].aspect) / std::min(patch.aspect, patches[i].aspect);
+        if (aspectRatio > maxAspectRatio) {
+            continue;
+        }
+
+        double correlation = patch.pixels.dot(patches[i].pixels);
+        if (correlation > bestCorrelation) {
+            bestCorrelation = correlation;
+            res = sizes[i];
+        }
+    }
+    return res;
+}
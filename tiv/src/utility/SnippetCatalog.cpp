@@ -0,0 +1,82 @@
+#include "utility/SnippetCatalog.hpp"
+
+std::string SnippetCatalog::getFormId(const SnippetInfo& info) {
+    return info.scripter + info.page;
+}
+
+void SnippetCatalog::add(const SnippetInfo& info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t index = infos.size();
+    infos.push_back(info);
+
+    std::string formId = getFormId(info);
+    byForm[formId].push_back(index);
+    byLabel[info.label].push_back(index);
+    byPosition[std::make_tuple(formId, info.row, info.column)] = index;
+    byName[info.getName()] = index;
+}
+
+size_t SnippetCatalog::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return infos.size();
+}
+
+size_t SnippetCatalog::countForm(const std::string& formId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byForm.find(formId);
+    return it != byForm.end() ? it->second.size() : 0;
+}
+
+bool SnippetCatalog::getFormSnippet(const std::string& formId, size_t index, SnippetInfo& info) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byForm.find(formId);
+    if (it == byForm.end() || index >= it->second.size()) {
+        return false;
+    }
+    info = infos[it->second[index]];
+    return true;
+}
+
+std::vector<SnippetInfo> SnippetCatalog::getForm(const std::string& formId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SnippetInfo> res;
+    auto it = byForm.find(formId);
+    if (it != byForm.end()) {
+        for (size_t index : it->second) {
+            res.push_back(infos[index]);
+        }
+    }
+    return res;
+}
+
+bool SnippetCatalog::find(const std::string& formId, unsigned int row, unsigned int column, SnippetInfo& info) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byPosition.find(std::make_tuple(formId, row, column));
+    if (it == byPosition.end()) {
+        return false;
+    }
+    info = infos[it->second];
+    return true;
+}
+
+bool SnippetCatalog::findByName(const std::string& name, SnippetInfo& info) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byName.find(name);
+    if (it == byName.end()) {
+        return false;
+    }
+    info = infos[it->second];
+    return true;
+}
+
+std::vector<SnippetInfo> SnippetCatalog::getLabel(const std::string& label) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SnippetInfo> res;
+    auto it = byLabel.find(label);
+    if (it != byLabel.end()) {
+        for (size_t index : it->second) {
+            res.push_back(infos[index]);
+        }
+    }
+    return res;
+}
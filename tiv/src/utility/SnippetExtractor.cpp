@@ -3,14 +3,24 @@
 //
 
 #include "utility/SnippetExtractor.hpp"
+#include "utility/SnippetInfo.hpp"
+#include "utility/SnippetSink.hpp"
+#include <opencv2/calib3d.hpp>
 #include <sstream>
 #include <opencv2/imgcodecs.hpp>
 #include <fstream>
 #include <iostream>
 #include <sys/stat.h>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/core/version.hpp>
 #include <numeric>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <mutex>
+#include <functional>
 
 
 // Margin
@@ -19,37 +29,296 @@ const unsigned int SnippetExtractor::margin = 10;
 // Error factor allowed when checking size and area
 const double SnippetExtractor::errorFactor = 0.9;
 
+// Sink used when none is given : saves the snippets in the output directory
+DiskSnippetSink SnippetExtractor::defaultSink;
+
+// Borders needed around a snippet by the interpolations
+const int SnippetExtractor::subPixBorder = 2;
+const int SnippetExtractor::cubicBorder = 3;
+
+// Reduction of the page on which a layout is placed
+const int SnippetExtractor::registrationScale = 4;
+
+// Every cell of the layout is emitted : a few missing candidates only (a damaged frame, a stain)
+const double SnippetExtractor::registrationMinCells = 0.9;
+
+// Offsets of our forms, used when no layout is given
+const FormLayout SnippetExtractor::defaultLayout;
+
+// Rows of a band to binarize : the buffers of a band fit in the L2 cache for the usual scans
+const int SnippetExtractor::bandRows = 64;
+
+// Allocations of all the extractors
+std::atomic<size_t> SnippetExtractor::s_totalAllocations(0);
+
 
 
 SnippetExtractor::SnippetExtractor() :
-m_snippetArea(0){
-    // Create the output directory
-    mkdir("output", 0777); // 0777 : permission all
+m_extractionMode(ExtractionMode::PerSnippet),
+m_detectionScale(1),
+m_detectionBackend(DetectionBackend::Contours),
+m_layout(nullptr),
+m_imageScale(1),
+m_sink(&defaultSink),
+m_catalog(nullptr),
+m_skewCos(1),
+m_skewSin(0),
+m_snippetArea(0),
+m_bucketSize(1),
+m_bucketCols(0),
+m_bucketRows(0),
+m_nbAllocations(0){
+    // Create the output directory (once for all the extractors)
+    static std::once_flag outputCreated;
+    std::call_once(outputCreated, [] { mkdir("output", 0777); }); // 0777 : permission all
+}
+
+
+
+SnippetExtractor::~SnippetExtractor() {
+    // The allocations of the last page were not counted by reset
+    BufferList buffers;
+    listBuffers(buffers);
+    s_totalAllocations += countAllocations(m_buffers, buffers);
 }
 
 
 
 bool SnippetExtractor::setImage(const cv::Mat &image) {
-    // Copy the image
-    m_image = image.clone();
-    m_unchangedImage= image.clone();
+    // Binarize the image
+    binarize(image);
+
+    // Find the grid of snippets
+    return detectGrid();
+}
+
+
+
+bool SnippetExtractor::setImage(cv::Mat &&image) {
+    // Binarize the image
+    binarize(std::move(image));
+
+    // Find the grid of snippets
+    return detectGrid();
+}
+
+
+
+void SnippetExtractor::reset() {
+    // Count the buffers allocated for the previous page
+    BufferList buffers;
+    listBuffers(buffers);
+    size_t nbAllocations = countAllocations(m_buffers, buffers);
+    m_nbAllocations += nbAllocations;
+    s_totalAllocations += nbAllocations;
+
+    // Forget the previous page
+    m_currentRow = 0;
+    m_currentCol = 0;
+    m_snippetContourIndexes.clear();
+    m_boundingBoxes.clear();
+    m_snippetCenters.clear();
+    clearIndexGrid();
+    // (the snippets given in PageDeskew mode may still be views on the deskewed page)
+    m_deskewedImage.release();
+
+    // The buffers at the beginning of this page
+    listBuffers(m_buffers);
+}
+
+
+
+size_t SnippetExtractor::getNumberAllocations() const {
+    BufferList buffers;
+    listBuffers(buffers);
+    return m_nbAllocations + countAllocations(m_buffers, buffers);
+}
+
+
+
+size_t SnippetExtractor::getTotalAllocations() {
+    return s_totalAllocations;
+}
+
+
+
+void SnippetExtractor::listBuffers(BufferList& buffers) const {
+    buffers.clear();
+    auto addMat = [&buffers](const cv::Mat& m) {
+        buffers.emplace_back(m.datastart, m.datalimit - m.datastart);
+    };
+    auto addVector = [&buffers](const void* data, size_t capacity) {
+        buffers.emplace_back(data, capacity);
+    };
+
+    addMat(m_image);
+    addMat(m_reducedImage);
+    addMat(m_rotatedSnippet);
+    addMat(m_snippetMapXY);
+    addMat(m_snippetMapA);
+    addVector(m_snippetCorners.data(), m_snippetCorners.capacity());
+    addVector(m_snippetBuffers.data(), m_snippetBuffers.capacity());
+    addVector(m_rowSnippets.data(), m_rowSnippets.capacity());
+    addVector(m_hierarchy.data(), m_hierarchy.capacity());
+    addVector(m_contourAreas.data(), m_contourAreas.capacity());
+    addVector(m_contourBoxes.data(), m_contourBoxes.capacity());
+    addMat(m_labels);
+    addMat(m_stats);
+    addMat(m_centroids);
+    addMat(m_componentMask);
+    addVector(m_componentContours.data(), m_componentContours.capacity());
+    addVector(m_registrationPoints.data(), m_registrationPoints.capacity());
+    addVector(m_registrationCells.data(), m_registrationCells.capacity());
+    addVector(m_registrationErrors.data(), m_registrationErrors.capacity());
+    addVector(m_layoutPoints.data(), m_layoutPoints.capacity());
+    addVector(m_pagePoints.data(), m_pagePoints.capacity());
+    addVector(m_registrationInliers.data(), m_registrationInliers.capacity());
+    addVector(m_snippetContourIndexes.data(), m_snippetContourIndexes.capacity());
+    addVector(m_boundingBoxes.data(), m_boundingBoxes.capacity());
+    addVector(m_snippetCenters.data(), m_snippetCenters.capacity());
+    addVector(m_bucketStart.data(), m_bucketStart.capacity());
+    addVector(m_bucketBoxes.data(), m_bucketBoxes.capacity());
+    addVector(m_bucketNext.data(), m_bucketNext.capacity());
+    addVector(m_contours.data(), m_contours.capacity());
+    addVector(m_indexgrid.data(), m_indexgrid.capacity());
+    addVector(m_spareRows.data(), m_spareRows.capacity());
+    for (const std::vector<cv::Point>& contour : m_contours) {
+        addVector(contour.data(), contour.capacity());
+    }
+    for (const std::vector<int>& row : m_indexgrid) {
+        addVector(row.data(), row.capacity());
+    }
+    for (const std::vector<int>& row : m_spareRows) {
+        addVector(row.data(), row.capacity());
+    }
+    for (const std::vector<cv::Mat>& row : m_snippetBuffers) {
+        addVector(row.data(), row.capacity());
+        for (const cv::Mat& snippet : row) {
+            addMat(snippet);
+        }
+    }
+}
+
+
+
+size_t SnippetExtractor::countAllocations(const BufferList& before, const BufferList& after) {
+    // A buffer was allocated if it is new, or if it moved
+    size_t res = 0;
+    for (size_t i = 0; i < after.size(); i++) {
+        if (after[i].second > 0 && (i >= before.size() || after[i].first != before[i].first)) {
+            res++;
+        }
+    }
+    return res;
+}
+
+
+
+void SnippetExtractor::binarize(const cv::Mat &image) {
+    reset();
+
+    // Copy the image (in the buffer of the previous one if it has the same size)
+    // The views given on the previous page (getImage, getReferences) must not be overwritten :
+    // its buffer is only reused if nothing else holds it
+    if (m_unchangedImage.u && m_unchangedImage.u->refcount > 1) {
+        m_unchangedImage.release();
+    }
+    image.copyTo(m_unchangedImage);
+
+    binarizeUnchangedImage(m_layout ? registrationScale : m_detectionScale);
+}
+
+
+
+void SnippetExtractor::binarize(cv::Mat &&image) {
+    reset();
+
+    // Take the image without copy
+    m_unchangedImage = std::move(image);
+
+    binarizeUnchangedImage(m_layout ? registrationScale : m_detectionScale);
+}
+
+
+
+void SnippetExtractor::binarizeUnchangedImage(int scale) {
+    // The snippets can be detected on a reduced page
+    m_imageScale = scale;
+    cv::Mat source = m_unchangedImage;
+    if (scale > 1) {
+        cv::resize(m_unchangedImage, m_reducedImage, cv::Size(), 1. / scale, 1. / scale, cv::INTER_AREA);
+        source = m_reducedImage;
+    }
+
+    // Apply Filters on each band, in parallel
+    m_image.create(source.size(), CV_8UC1);
+    int nbBands = (source.rows + bandRows - 1) / bandRows;
+    cv::parallel_for_(cv::Range(0, nbBands), [this, &source](const cv::Range& bands) {
+        for (int band = bands.start; band < bands.end; band++) {
+            binarizeBand(source, cv::Range(band * bandRows, std::min(source.rows, (band + 1) * bandRows)));
+        }
+    });
+}
+
+
+
+void SnippetExtractor::binarizeBand(const cv::Mat& image, const cv::Range& rows) {
+    // The threshold neighborhood follows the reduction of the page (11x11 at full resolution)
+    const int blockSize = std::max(3, (11 / m_imageScale) | 1);
+
+    // Neighbor rows needed by the blur (3x3) and by the threshold
+    const int blurHalo = 1, thresholdHalo = blockSize / 2;
+
+    // Rows of the band after each filter (the borders of the page are handled by the filters themselves)
+    cv::Range blurRows(std::max(0, rows.start - thresholdHalo), std::min(image.rows, rows.end + thresholdHalo));
+    cv::Range grayRows(std::max(0, blurRows.start - blurHalo), std::min(image.rows, blurRows.end + blurHalo));
+
+    // Buffers of the filters, kept by each worker from one band to the next
+    static thread_local cv::Mat gray, blurred, binary;
 
     // Apply Filters
-    cv::cvtColor(m_image, m_image, cv::COLOR_BGR2GRAY); // Gray scale
-    cv::GaussianBlur(m_image, m_image, cv::Size(3, 3), 0); // Blur
-    cv::adaptiveThreshold(m_image, m_image, 255, 1, 1, 11, 15); // Threshold
+    cv::cvtColor(image.rowRange(grayRows), gray, cv::COLOR_BGR2GRAY); // Gray scale
+    cv::GaussianBlur(gray, blurred, cv::Size(3, 3), 0); // Blur
+    cv::Mat blurredRows = blurred.rowRange(blurRows.start - grayRows.start, blurRows.end - grayRows.start);
+    cv::adaptiveThreshold(blurredRows, binary, 255, 1, 1, blockSize, 15); // Threshold
+
+    // Keep the rows of the band
+    binary.rowRange(rows.start - blurRows.start, rows.end - blurRows.start).copyTo(m_image.rowRange(rows));
+}
+
+
+
+bool SnippetExtractor::detectGrid() {
+    // Place the layout of the forms on the page, without analysing the contours
+    if (m_layout) {
+        if (registerLayout()) {
+            // Rotate the page once if needed
+            if (m_extractionMode == ExtractionMode::PageDeskew) {
+                deskewPage();
+            }
+            return true;
+        }
+
+        // Fall back on the detection of the snippets
+        if (m_imageScale != m_detectionScale) {
+            binarizeUnchangedImage(m_detectionScale);
+        }
+    }
 
     // Extract the contours
     findSnippetContours();
 
     // If there isn't 35 snippets it means that there is a problem with the extraction or the image so we return false
     // (for example : the image n°22 should not have 35 snippets)
-    if(m_snippetContours.size() < 10) {
-    // if (m_snippetContours.size() != 35) {
-        std::cout << "Found " << m_snippetContours.size() << " snippets " << std::endl;
+    if(m_snippetContourIndexes.size() < 10) {
+    // if (m_snippetContourIndexes.size() != 35) {
+        std::cout << "Found " << m_snippetContourIndexes.size() << " snippets " << std::endl;
         return false;
     }
 
+    // Index the bounding boxes by position
+    buildSpatialHash();
+
     // Find the snippet centers
     findSnippetCenters();
 
@@ -62,13 +331,85 @@ bool SnippetExtractor::setImage(const cv::Mat &image) {
     // Build the index grid
     buildIndexGrid();
 
+    // Go back to the coordinates of the unchanged image
+    if (m_imageScale > 1) {
+        scaleDetection();
+    }
+
+    // Rotate the page once if needed
+    if (m_extractionMode == ExtractionMode::PageDeskew) {
+        deskewPage();
+    }
+
     return true;
 }
 
 
 
+const cv::Mat& SnippetExtractor::getImage() const {
+    return m_unchangedImage;
+}
+
+
+
+void SnippetExtractor::setExtractionMode(ExtractionMode mode) {
+    m_extractionMode = mode;
+}
+
+
+
+void SnippetExtractor::setDetectionBackend(DetectionBackend backend) {
+    m_detectionBackend = backend;
+}
+
+
+
+void SnippetExtractor::setLayout(const FormLayout* layout) {
+    m_layout = layout && layout->hasGrid() ? layout : nullptr;
+}
+
+
+
+const FormLayout& SnippetExtractor::layout() const {
+    return m_layout ? *m_layout : defaultLayout;
+}
+
+
+
+void SnippetExtractor::setDetectionScale(int scale) {
+    m_detectionScale = std::max(1, scale);
+}
+
+
+
+void SnippetExtractor::setSink(SnippetSink* sink) {
+    m_sink = sink ? sink : &defaultSink;
+}
+
+
+
+void SnippetExtractor::setCatalog(SnippetCatalog* catalog) {
+    m_catalog = catalog;
+}
+
+
+
 void SnippetExtractor::extractRow(uint row, const std::string& iconName, const std::string iconSize,
                                   const std::string &scripterNum, const std::string pageNum) {
+    // Crop the snippets of the row
+    m_rowSnippets.clear();
+    cropRow(row, m_rowSnippets);
+
+    // Save them
+    saveRow(row, m_rowSnippets, iconName, iconSize, scripterNum, pageNum);
+
+    // Release the snippets, so that their buffers can be reused by the next page
+    m_rowSnippets.clear();
+}
+
+
+
+void SnippetExtractor::cropRow(uint row, std::vector<cv::Mat> &snippets) {
 
     m_currentRow = row;
 
@@ -79,38 +420,199 @@ void SnippetExtractor::extractRow(uint row, const std::string& iconName, const s
 
     // For each column in the row
     for(m_currentCol = 0; m_currentCol < m_indexgrid[m_currentRow].size(); m_currentCol++){
-        // Get the Region to extract
-        cv::RotatedRect rect(snippetRect());
-
-        // matrices we'll use
-        cv::Mat M, rotated, cropped;
-        // get angle and size from the bounding box
-        float angle = rect.angle;
-        cv::Size rect_size = rect.size;
-        // thanks to http://felix.abecassis.me/2011/10/opencv-rotation-deskewing/
-        if (rect.angle < -45.) {
-            angle += 90.0;
-            cv::swap(rect_size.width, rect_size.height);
+        cv::Mat res;
+        if (m_extractionMode == ExtractionMode::PageDeskew) {
+            // The page is already straight, the snippet is only a view on it
+            res = deskewedSnippet();
         }
-        // get the rotation matrix
-        M = getRotationMatrix2D(rect.center, angle, 1.0);
-        // perform the affine transformation
-        warpAffine(m_unchangedImage, rotated, M, m_unchangedImage.size(), cv::INTER_CUBIC);
-        // crop the resulting image
-        getRectSubPix(rotated, rect_size, rect.center, cropped);
+        else {
+            // Get the Region to extract
+            cv::RotatedRect rect(snippetRect());
+
+            // Deskew the snippet in its buffer, unless the previous snippet there is still used
+            if (m_snippetBuffers.size() <= m_currentRow) {
+                m_snippetBuffers.resize(m_currentRow + 1);
+            }
+            if (m_snippetBuffers[m_currentRow].size() <= m_currentCol) {
+                m_snippetBuffers[m_currentRow].resize(m_currentCol + 1);
+            }
+            cv::Mat& cropped = m_snippetBuffers[m_currentRow][m_currentCol];
+            if (cropped.u && cropped.u->refcount > 1) {
+                cropped.release();
+            }
+            deskewSnippet(rect, cropped);
+
+            // Change the extracted rect
+            cv::Rect rect2(margin, margin, cropped.cols - 2*margin, cropped.rows - 2*margin);
+            res = cropped(rect2);
+        }
+
+        snippets.push_back(res);
+    }
+}
 
-        // Change the extracted rect
-        cv::Rect rect2(margin, margin, cropped.cols - 2*margin, cropped.rows - 2*margin);
-        cv::Mat res = cropped(rect2);
 
+
+void SnippetExtractor::saveRow(uint row, const std::vector<cv::Mat> &snippets, const std::string &iconName,
+                               const std::string iconSize, const std::string &scripterNum, const std::string pageNum) {
+
+    m_currentRow = row;
+
+    // For each snippet of the row
+    for(m_currentCol = 0; m_currentCol < snippets.size(); m_currentCol++){
         // Save the snippet
         std::string savePath(generateFileName(iconName, scripterNum, pageNum));
-        save(res, savePath, iconName, iconSize, scripterNum, pageNum);
+        save(snippets[m_currentCol], savePath, iconName, iconSize, scripterNum, pageNum);
     }
 }
 
 
 
+void SnippetExtractor::deskewSnippet(const cv::RotatedRect& rect, cv::Mat& cropped) {
+    // get angle and size from the bounding box
+    float angle = rect.angle;
+    cv::Size rect_size = rect.size;
+    // thanks to http://felix.abecassis.me/2011/10/opencv-rotation-deskewing/
+    if (rect.angle < -45.) {
+        angle += 90.0;
+        cv::swap(rect_size.width, rect_size.height);
+    }
+    // get the rotation matrix (as getRotationMatrix2D, with the same rounding, without allocating it)
+    double radians = angle * (CV_PI / 180);
+    double alpha = std::cos(radians), beta = std::sin(radians);
+    cv::Matx23d M(alpha, beta, (1 - alpha) * rect.center.x - beta * rect.center.y,
+                  -beta, alpha, beta * rect.center.x + (1 - alpha) * rect.center.y);
+
+    // Only the pixels around the snippet are resampled instead of the whole page :
+    // the region of the rotated page read by getRectSubPix (with a border for its bilinear interpolation)
+    cv::Rect page(0, 0, m_unchangedImage.cols, m_unchangedImage.rows);
+    cv::Rect dstRegion(cvFloor(rect.center.x - rect_size.width / 2.) - subPixBorder,
+                       cvFloor(rect.center.y - rect_size.height / 2.) - subPixBorder,
+                       rect_size.width + 2 * subPixBorder + 1,
+                       rect_size.height + 2 * subPixBorder + 1);
+    dstRegion &= page;
+
+    if (dstRegion.empty()) {
+        cropped.create(rect_size, m_unchangedImage.type());
+        cropped.setTo(0);
+        return;
+    }
+
+    cv::Matx23d iM;
+    cv::invertAffineTransform(M, iM);
+
+#if CV_VERSION_MAJOR < 5
+    // warpAffine resamples the page through fixed-point maps, computed from the page coordinates
+    // of each pixel : the same maps, computed for the pixels of the region only, give exactly
+    // the pixels of the whole rotated page
+    const int abBits = 10, abScale = 1 << abBits, interBits = 5, interTabSize = 1 << interBits;
+    const int roundDelta = abScale / interTabSize / 2;
+    m_snippetMapXY.create(dstRegion.size(), CV_16SC2);
+    m_snippetMapA.create(dstRegion.size(), CV_16UC1);
+    for (int y = 0; y < dstRegion.height; y++) {
+        int pageY = dstRegion.y + y;
+        int X0 = cv::saturate_cast<int>((iM(0, 1) * pageY + iM(0, 2)) * abScale) + roundDelta;
+        int Y0 = cv::saturate_cast<int>((iM(1, 1) * pageY + iM(1, 2)) * abScale) + roundDelta;
+        short* XY = m_snippetMapXY.ptr<short>(y);
+        ushort* A = m_snippetMapA.ptr<ushort>(y);
+        for (int x = 0; x < dstRegion.width; x++) {
+            int pageX = dstRegion.x + x;
+            int X = (X0 + cv::saturate_cast<int>(iM(0, 0) * pageX * abScale)) >> (abBits - interBits);
+            int Y = (Y0 + cv::saturate_cast<int>(iM(1, 0) * pageX * abScale)) >> (abBits - interBits);
+            XY[x * 2] = cv::saturate_cast<short>(X >> interBits);
+            XY[x * 2 + 1] = cv::saturate_cast<short>(Y >> interBits);
+            A[x] = (ushort)((Y & (interTabSize - 1)) * interTabSize + (X & (interTabSize - 1)));
+        }
+    }
+
+    // perform the affine transformation (in the buffer of the previous snippet)
+    remap(m_unchangedImage, m_rotatedSnippet, m_snippetMapXY, m_snippetMapA, cv::INTER_CUBIC, cv::BORDER_CONSTANT);
+#else
+    // The maps of warpAffine are not exposed any more : the rotation is expressed between the region
+    // and the region of the page mapped into it (with a border for the cubic interpolation),
+    // which only changes the rounding of the translation (at most 1 grey level on the snippets)
+    m_snippetCorners.assign({dstRegion.tl(), cv::Point2f(dstRegion.x + dstRegion.width, dstRegion.y),
+                             dstRegion.br(), cv::Point2f(dstRegion.x, dstRegion.y + dstRegion.height)});
+    cv::transform(m_snippetCorners, m_snippetCorners, iM);
+    cv::Rect srcRegion(cv::boundingRect(m_snippetCorners));
+    srcRegion -= cv::Point(cubicBorder, cubicBorder);
+    srcRegion += cv::Size(2 * cubicBorder, 2 * cubicBorder);
+    srcRegion &= page;
+
+    if (srcRegion.empty()) {
+        cropped.create(rect_size, m_unchangedImage.type());
+        cropped.setTo(0);
+        return;
+    }
+
+    M(0, 2) += M(0, 0) * srcRegion.x + M(0, 1) * srcRegion.y - dstRegion.x;
+    M(1, 2) += M(1, 0) * srcRegion.x + M(1, 1) * srcRegion.y - dstRegion.y;
+
+    // perform the affine transformation (in the buffer of the previous snippet)
+    warpAffine(m_unchangedImage(srcRegion), m_rotatedSnippet, M, dstRegion.size(), cv::INTER_CUBIC);
+#endif
+    // crop the resulting image
+    getRectSubPix(m_rotatedSnippet, rect_size, rect.center - cv::Point2f(dstRegion.x, dstRegion.y), cropped);
+}
+
+
+
+void SnippetExtractor::deskewPage() {
+    // The vector to the right snippet gives the skew of the whole page
+    double angle = std::atan2(m_vectorRight.y, m_vectorRight.x) * 180 / CV_PI;
+    m_skewCos = std::abs(std::cos(angle * CV_PI / 180));
+    m_skewSin = std::abs(std::sin(angle * CV_PI / 180));
+
+    // Rotate the page around its center
+    cv::Point2f pageCenter(m_unchangedImage.cols / 2.f, m_unchangedImage.rows / 2.f);
+    m_deskewMatrix = getRotationMatrix2D(pageCenter, angle, 1.0);
+
+    // Release the previous page first : the views given on it must not be overwritten
+    m_deskewedImage.release();
+    warpAffine(m_unchangedImage, m_deskewedImage, m_deskewMatrix, m_unchangedImage.size(), cv::INTER_CUBIC);
+}
+
+
+
+cv::Point2f SnippetExtractor::toDeskewed(const cv::Point2f& point) const {
+    const double* M0 = m_deskewMatrix.ptr<double>(0);
+    const double* M1 = m_deskewMatrix.ptr<double>(1);
+    return cv::Point2f(M0[0] * point.x + M0[1] * point.y + M0[2],
+                       M1[0] * point.x + M1[1] * point.y + M1[2]);
+}
+
+
+
+cv::Mat SnippetExtractor::deskewedSnippet() const {
+    const cv::Rect& box = m_boundingBoxes[m_indexgrid[m_currentRow][m_currentCol]];
+
+    // The bounding box of a square of side s rotated by the skew has a side of s * (|cos| + |sin|)
+    double factor = m_skewCos + m_skewSin;
+    cv::Size2f size(box.width / factor, box.height / factor);
+    cv::Point2f center = toDeskewed(cv::Point2f(box.x + box.width / 2.f, box.y + box.height / 2.f));
+
+    // Region of the snippet without its margin
+    cv::Rect region(cvRound(center.x - size.width / 2) + margin, cvRound(center.y - size.height / 2) + margin,
+                    cvRound(size.width) - 2 * margin, cvRound(size.height) - 2 * margin);
+    region &= cv::Rect(0, 0, m_deskewedImage.cols, m_deskewedImage.rows);
+
+    return m_deskewedImage(region);
+}
+
+
+
+cv::Mat SnippetExtractor::cropSquare(const cv::Mat& image, const cv::Point& center, double width) const {
+    cv::Point2f c(center);
+    if (m_extractionMode == ExtractionMode::PageDeskew) {
+        c = toDeskewed(c);
+    }
+    cv::Rect crop_region(c.x - width/2, c.y - width/2, width, width);
+    crop_region &= cv::Rect(0, 0, image.cols, image.rows);
+    return image(crop_region);
+}
+
+
+
 uint SnippetExtractor::getNumberRows() const {
     return m_indexgrid.size();
 }
@@ -122,8 +624,8 @@ cv::Point SnippetExtractor::getIconCenter(uint row) const {
     cv::Point snippetCenter(m_snippetCenters[m_indexgrid[row][0]]);
     // Get the icon center
     cv::Point iconCenter;
-    iconCenter.x = snippetCenter.x - (m_vectorRight.x + m_vectorBottom.x) * 1.14;
-    iconCenter.y = snippetCenter.y - m_vectorRight.y * 1.14;
+    iconCenter.x = snippetCenter.x - (m_vectorRight.x + m_vectorBottom.x) * layout().iconOffset;
+    iconCenter.y = snippetCenter.y - m_vectorRight.y * layout().iconOffset;
 
     return iconCenter;
 }
@@ -141,7 +643,7 @@ cv::RotatedRect SnippetExtractor::snippetRect() const {
     int index = m_indexgrid[m_currentRow][m_currentCol];
 
     // Get the Rotated rect
-    cv::RotatedRect rect(cv::minAreaRect(m_snippetContours[index]));
+    cv::RotatedRect rect(cv::minAreaRect(m_contours[m_snippetContourIndexes[index]]));
 
     // Return the rectangle of minimum area
     return rect;
@@ -165,77 +667,65 @@ std::string SnippetExtractor::generateFileName(const std::string& iconName, cons
 void SnippetExtractor::save(const cv::Mat &snippet, const std::string &path, const std::string &iconName,
                             const std::string iconSize, const std::string &scripterNum,
                             const std::string pageNum) const {
-    // Save the Snippet picture
-    cv::imwrite(path + ".png", snippet);
-
-    // Write the Txt File
-    std::ofstream txt(path + ".txt");
-
-    // If the file opened
-    if(txt){
-        // Putting comments
-        txt << "# Groupe 7 | INFO 4" << std::endl;
-        txt << "# Members : " << std::endl;
-        txt << "# ROBERT   Mathis      |   HU     Romain" << std::endl;
-        txt << "# Nicaudie Charlotte   |   MALLAM GABRA Dakini" << std::endl;
-
-        // Putting Data
-        txt << "label " << iconName << std::endl;
-        txt << "form " << scripterNum << pageNum << std::endl;
-        txt << "scripter " << scripterNum << std::endl;
-        txt << "page " << pageNum << std::endl;
-        txt << "row " << m_currentRow << std::endl;
-        txt << "column " << m_currentCol << std::endl;
-        txt << "size " << iconSize << std::endl;
-
-        // Close the file
-        txt.close();
-    }
-    else{
-        std::cout << "Could not open file " << path << ".txt" << std::endl;
+    // Describe the snippet
+    SnippetInfo info;
+    info.path = path;
+    info.label = iconName;
+    info.size = iconSize;
+    info.scripter = scripterNum;
+    info.page = pageNum;
+    info.row = m_currentRow;
+    info.column = m_currentCol;
+
+    // Give it to the sink (saved on the disk by default)
+    m_sink->consume(snippet, info);
+
+    // Record it, so that it can be found without listing the output
+    if (m_catalog) {
+        m_catalog->add(info);
     }
 }
 
 
 
 void SnippetExtractor::findSnippetContours() {
-    // Clear the previous contours
-    m_snippetContours.clear();
+    // Clear the previous contours (their buffers are kept)
+    m_snippetContourIndexes.clear();
     m_boundingBoxes.clear();
 
+    // The connected components give the boxes without tracing every contour
+    if (m_detectionBackend == DetectionBackend::ConnectedComponents) {
+        findSnippetComponents();
+        return;
+    }
+
     // Find the contour with OpenCV
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Vec4i> hierarchy;
-    findContours(m_image, contours, hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>>& contours = m_contours;
+    findContours(m_image, contours, m_hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
 
 
-    // Find the contour areas
-    std::vector<double> areas;
+    // Find the contour bounding boxes and areas
+    m_contourBoxes.clear();
+    m_contourAreas.clear();
     for(int i = 0 ; i < contours.size(); i++){
         cv::Rect rect(boundingRect(contours[i]));
 
-        areas.push_back(rect.width * rect.height);
+        m_contourBoxes.push_back(rect);
+        m_contourAreas.push_back(rect.width * rect.height);
     }
 
-    // Sort the areas
-    std::vector<double> areasSorted(areas);
-    std::sort(areasSorted.begin(), areasSorted.end());
-    std::reverse(areasSorted.begin(), areasSorted.end());
-
     // Get the area of a snippet
-    int nbShapes = 5;
-    int nbShapesIgnored = 3; // Ignore some of the biggest shapes
-    m_snippetArea = std::accumulate(areasSorted.begin()+ nbShapesIgnored, areasSorted.begin() + nbShapes + nbShapesIgnored, 0) / (double)nbShapes;
+    estimateSnippetArea();
 
 
     // For each contour found
     for(int i = 0 ; i < contours.size(); i++) {
         // Draw only if it is a rectangle
-        cv::Rect rect(boundingRect(contours[i]));
+        const cv::Rect& rect = m_contourBoxes[i];
 
         if (isSquare(rect) && hasSnippetSize(rect.width * rect.height)) {
                 // Save the contour
-                m_snippetContours.push_back(contours[i]);
+                m_snippetContourIndexes.push_back(i);
                 m_boundingBoxes.push_back(rect);
         }
     }
@@ -243,12 +733,335 @@ void SnippetExtractor::findSnippetContours() {
 
 
 
+bool SnippetExtractor::registerLayout() {
+    const FormLayout& layout = *m_layout;
+    const int s = m_imageScale;
+    const int nbCells = layout.rows * layout.columns;
+    const size_t minCells = (size_t) std::ceil(registrationMinCells * nbCells);
+
+    // Expected size of a snippet on the reduced page (the pages can be scanned at another resolution)
+    double pageFactor = (double) m_unchangedImage.cols / layout.pageSize.width;
+    double side = layout.snippetSide * pageFactor / s;
+    m_snippetArea = side * side;
+
+    // The candidates are the square components of the snippet size (their centers on the unchanged image)
+    int nbLabels = cv::connectedComponentsWithStats(m_image, m_labels, m_stats, m_centroids, 8, CV_32S);
+    std::vector<cv::Point2f>& candidates = m_registrationPoints;
+    candidates.clear();
+    for (int i = 1; i < nbLabels; i++) {
+        const int* stats = m_stats.ptr<int>(i);
+        cv::Rect rect(stats[cv::CC_STAT_LEFT], stats[cv::CC_STAT_TOP], stats[cv::CC_STAT_WIDTH], stats[cv::CC_STAT_HEIGHT]);
+        if (isSquare(rect) && hasSnippetSize(rect.width * rect.height)) {
+            candidates.emplace_back((rect.x + rect.width / 2.f) * s - 0.5f, (rect.y + rect.height / 2.f) * s - 0.5f);
+        }
+    }
+    if (candidates.size() < minCells) {
+        return false;
+    }
+
+    // First guess : the top left candidate is the first snippet, and the page is only scaled
+    cv::Point2f topLeft = *std::min_element(candidates.begin(), candidates.end(),
+            [] (const cv::Point2f& p1, const cv::Point2f& p2) {return p1.x + p1.y < p2.x + p2.y;});
+    cv::Matx23d transform(pageFactor, 0, topLeft.x - pageFactor * layout.origin.x,
+                          0, pageFactor, topLeft.y - pageFactor * layout.origin.y);
+
+    // From the layout to the position in the grid, in columns and rows
+    cv::Matx22d toGrid = cv::Matx22d(layout.pitchRight.x, layout.pitchBottom.x,
+                                     layout.pitchRight.y, layout.pitchBottom.y).inv();
+    double threshold = 0.1 * cv::norm(layout.pitchRight) * pageFactor;
+
+    // Match the candidates with the cells of the grid, then fit the transform on them (twice : the first guess ignores the skew)
+    for (int pass = 0; pass < 2; pass++) {
+        cv::Matx23d inverse;
+        cv::invertAffineTransform(transform, inverse);
+
+        // Each cell keeps its closest candidate (at most a quarter of the grid vectors away)
+        m_registrationCells.assign(nbCells, -1);
+        m_registrationErrors.assign(nbCells, 0.25 * 0.25);
+        for (int j = 0; j < candidates.size(); j++) {
+            cv::Vec2d onLayout = inverse * cv::Vec3d(candidates[j].x, candidates[j].y, 1);
+            cv::Vec2d onGrid = toGrid * cv::Vec2d(onLayout[0] - layout.origin.x, onLayout[1] - layout.origin.y);
+            int column = cvRound(onGrid[0]), row = cvRound(onGrid[1]);
+            double error = (onGrid[0] - column) * (onGrid[0] - column) + (onGrid[1] - row) * (onGrid[1] - row);
+            if (row < 0 || row >= layout.rows || column < 0 || column >= layout.columns) {
+                continue;
+            }
+            int cell = row * layout.columns + column;
+            if (error < m_registrationErrors[cell]) {
+                m_registrationErrors[cell] = error;
+                m_registrationCells[cell] = j;
+            }
+        }
+
+        m_layoutPoints.clear();
+        m_pagePoints.clear();
+        for (int cell = 0; cell < nbCells; cell++) {
+            if (m_registrationCells[cell] != -1) {
+                m_layoutPoints.push_back(layout.snippetCenter(cell / layout.columns, cell % layout.columns));
+                m_pagePoints.push_back(candidates[m_registrationCells[cell]]);
+            }
+        }
+        if (m_layoutPoints.size() < minCells) {
+            return false;
+        }
+
+        // Rotation, uniform scale and translation
+        cv::Mat estimate = cv::estimateAffinePartial2D(m_layoutPoints, m_pagePoints, m_registrationInliers,
+                                                       cv::RANSAC, threshold);
+        if (estimate.empty() || (size_t) cv::countNonZero(m_registrationInliers) < minCells) {
+            return false;
+        }
+        transform = cv::Matx23d(estimate);
+    }
+
+    // The grid vectors and the side of a snippet on the page
+    cv::Matx22d linear(transform(0, 0), transform(0, 1), transform(1, 0), transform(1, 1));
+    cv::Vec2d right = linear * cv::Vec2d(layout.pitchRight.x, layout.pitchRight.y);
+    cv::Vec2d bottom = linear * cv::Vec2d(layout.pitchBottom.x, layout.pitchBottom.y);
+    float sideOnPage = layout.snippetSide * std::sqrt(cv::determinant(linear));
+    float angle = std::atan2(right[1], right[0]) * 180 / CV_PI;
+
+    // Every snippet of the layout, as if it was found by the detection
+    m_snippetContourIndexes.clear();
+    m_boundingBoxes.clear();
+    m_snippetCenters.clear();
+    clearIndexGrid();
+    int n = 0;
+    for (int row = 0; row < layout.rows; row++) {
+        for (int column = 0; column < layout.columns; column++, n++) {
+            cv::Point2f p = layout.snippetCenter(row, column);
+            cv::Vec2d center = transform * cv::Vec3d(p.x, p.y, 1);
+            cv::RotatedRect rect(cv::Point2f(center[0], center[1]), cv::Size2f(sideOnPage, sideOnPage), angle);
+
+            // The contour is the rotated square
+            cv::Point2f corners[4];
+            rect.points(corners);
+            if (n == m_contours.size()) {
+                m_contours.emplace_back();
+            }
+            m_contours[n].clear();
+            for (const cv::Point2f& corner : corners) {
+                m_contours[n].emplace_back(cvRound(corner.x), cvRound(corner.y));
+            }
+
+            m_snippetContourIndexes.push_back(n);
+            m_boundingBoxes.push_back(rect.boundingRect());
+            m_snippetCenters.emplace_back(cvRound(center[0]), cvRound(center[1]));
+            if (column == 0) {
+                addGridRow(n);
+            } else {
+                m_indexgrid.back().push_back(n);
+            }
+        }
+    }
+    m_contours.resize(n);
+
+    m_firstSnippet = 0;
+    m_vectorRight = cv::Point(cvRound(right[0]), cvRound(right[1]));
+    m_vectorBottom = cv::Point(cvRound(bottom[0]), cvRound(bottom[1]));
+    m_snippetArea = sideOnPage * sideOnPage;
+    return true;
+}
+
+
+
+bool SnippetExtractor::getLayout(FormLayout& layout) const {
+    // The grid vectors are fitted on all the snippets : at least 2 rows and 2 columns are needed
+    size_t columns = 0;
+    int nbCells = 0;
+    for (const std::vector<int>& row : m_indexgrid) {
+        columns = std::max(columns, row.size());
+        nbCells += row.size();
+    }
+    if (m_indexgrid.size() < 2 || columns < 2) {
+        return false;
+    }
+
+    // Least squares fit of center = origin + column * right + row * bottom, and mean side of the snippets
+    cv::Mat A(nbCells, 3, CV_64F), centersX(nbCells, 1, CV_64F), centersY(nbCells, 1, CV_64F);
+    double side = 0;
+    int n = 0;
+    for (int row = 0; row < m_indexgrid.size(); row++) {
+        for (int column = 0; column < m_indexgrid[row].size(); column++, n++) {
+            int index = m_indexgrid[row][column];
+            A.at<double>(n, 0) = 1;
+            A.at<double>(n, 1) = column;
+            A.at<double>(n, 2) = row;
+            centersX.at<double>(n) = m_snippetCenters[index].x;
+            centersY.at<double>(n) = m_snippetCenters[index].y;
+
+            cv::RotatedRect rect(cv::minAreaRect(m_contours[m_snippetContourIndexes[index]]));
+            side += (rect.size.width + rect.size.height) / 2;
+        }
+    }
+    cv::Mat x, y;
+    cv::solve(A, centersX, x, cv::DECOMP_SVD);
+    cv::solve(A, centersY, y, cv::DECOMP_SVD);
+
+    // The offsets are kept
+    FormLayout res = this->layout();
+    res.pageSize = m_unchangedImage.size();
+    res.origin = cv::Point2f(x.at<double>(0), y.at<double>(0));
+    res.pitchRight = cv::Point2f(x.at<double>(1), y.at<double>(1));
+    res.pitchBottom = cv::Point2f(x.at<double>(2), y.at<double>(2));
+    res.rows = m_indexgrid.size();
+    res.columns = columns;
+    res.snippetSide = side / nbCells;
+    layout = res;
+    return true;
+}
+
+
+
+void SnippetExtractor::findSnippetComponents() {
+    // Label the connected components : their bounding boxes come with the labels
+    int nbLabels = cv::connectedComponentsWithStats(m_image, m_labels, m_stats, m_centroids, 8, CV_32S);
+
+    // Find the component areas (the label 0 is the background)
+    m_contourAreas.clear();
+    for (int i = 1; i < nbLabels; i++) {
+        const int* stats = m_stats.ptr<int>(i);
+        m_contourAreas.push_back(stats[cv::CC_STAT_WIDTH] * stats[cv::CC_STAT_HEIGHT]);
+    }
+
+    // Get the area of a snippet
+    estimateSnippetArea();
+
+    // For each component found
+    size_t nbContours = 0;
+    for (int i = 1; i < nbLabels; i++) {
+        const int* stats = m_stats.ptr<int>(i);
+        cv::Rect rect(stats[cv::CC_STAT_LEFT], stats[cv::CC_STAT_TOP], stats[cv::CC_STAT_WIDTH], stats[cv::CC_STAT_HEIGHT]);
+        if (!isSquare(rect) || !hasSnippetSize(rect.width * rect.height)) {
+            continue;
+        }
+
+        // Only the contours of the snippets are traced, on a mask of the component (with an empty border)
+        m_componentMask.create(rect.height + 2, rect.width + 2, CV_8UC1);
+        m_componentMask.setTo(0);
+        cv::Mat inside = m_componentMask(cv::Rect(1, 1, rect.width, rect.height));
+        cv::compare(m_labels(rect), i, inside, cv::CMP_EQ);
+        findContours(m_componentMask, m_componentContours, m_hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE,
+                     cv::Point(rect.x - 1, rect.y - 1));
+        if (m_componentContours.empty()) {
+            continue;
+        }
+
+        // A component has a single external contour
+        auto contour = std::max_element(m_componentContours.begin(), m_componentContours.end(),
+                [] (const std::vector<cv::Point>& c1, const std::vector<cv::Point>& c2) {return c1.size() < c2.size();});
+        if (nbContours == m_contours.size()) {
+            m_contours.emplace_back();
+        }
+        m_contours[nbContours].assign(contour->begin(), contour->end());
+
+        // Save the contour
+        m_snippetContourIndexes.push_back(nbContours++);
+        m_boundingBoxes.push_back(rect);
+    }
+    m_contours.resize(nbContours);
+}
+
+
+
+void SnippetExtractor::estimateSnippetArea() {
+    // The snippet area is the mean of the areas ranked after the biggest shapes
+    const int nbShapes = 5;
+    const int nbShapesIgnored = 3; // Ignore some of the biggest shapes
+    std::vector<double>& areas = m_contourAreas;
+    if (areas.size() < (size_t) (nbShapes + nbShapesIgnored)) {
+        m_snippetArea = 0; // not a form : no snippet will be found
+        return;
+    }
+
+    // Partial selection instead of sorting all the areas : the biggest shapes first, then the next ones
+    std::nth_element(areas.begin(), areas.begin() + nbShapes + nbShapesIgnored - 1, areas.end(), std::greater<double>());
+    std::nth_element(areas.begin(), areas.begin() + nbShapesIgnored, areas.begin() + nbShapes + nbShapesIgnored,
+                     std::greater<double>());
+    m_snippetArea = std::accumulate(areas.begin() + nbShapesIgnored, areas.begin() + nbShapes + nbShapesIgnored, 0.) / nbShapes;
+}
+
+
+
+void SnippetExtractor::buildSpatialHash() {
+    // A snippet covers at most a few buckets
+    m_bucketSize = std::max(1., std::sqrt(m_snippetArea));
+
+    // The buckets cover all the boxes
+    int width = 0, height = 0;
+    for (const cv::Rect& rect : m_boundingBoxes) {
+        width = std::max(width, rect.x + rect.width);
+        height = std::max(height, rect.y + rect.height);
+    }
+    m_bucketCols = std::ceil(width / m_bucketSize);
+    m_bucketRows = std::ceil(height / m_bucketSize);
+    int nbBuckets = m_bucketCols * m_bucketRows;
+
+    // Range of buckets overlapped by each box
+    auto bucketRange = [this](const cv::Rect& rect, int& col0, int& col1, int& row0, int& row1) {
+        col0 = std::max(0, (int) (rect.x / m_bucketSize));
+        row0 = std::max(0, (int) (rect.y / m_bucketSize));
+        col1 = std::min(m_bucketCols - 1, (int) ((rect.x + rect.width - 1) / m_bucketSize));
+        row1 = std::min(m_bucketRows - 1, (int) ((rect.y + rect.height - 1) / m_bucketSize));
+    };
+
+    // Count the boxes of each bucket, then fill them (the boxes are added by increasing index)
+    m_bucketStart.assign(nbBuckets + 1, 0);
+    int col0, col1, row0, row1;
+    for (const cv::Rect& rect : m_boundingBoxes) {
+        bucketRange(rect, col0, col1, row0, row1);
+        for (int r = row0; r <= row1; r++)
+            for (int c = col0; c <= col1; c++)
+                m_bucketStart[r * m_bucketCols + c + 1]++;
+    }
+    for (int b = 0; b < nbBuckets; b++) {
+        m_bucketStart[b + 1] += m_bucketStart[b];
+    }
+
+    m_bucketBoxes.resize(m_bucketStart[nbBuckets]);
+    std::vector<int>& next = m_bucketNext;
+    next.assign(m_bucketStart.begin(), m_bucketStart.end() - 1);
+    for (int i = 0; i < m_boundingBoxes.size(); i++) {
+        bucketRange(m_boundingBoxes[i], col0, col1, row0, row1);
+        for (int r = row0; r <= row1; r++)
+            for (int c = col0; c <= col1; c++)
+                m_bucketBoxes[next[r * m_bucketCols + c]++] = i;
+    }
+}
+
+
+
+void SnippetExtractor::scaleDetection() {
+    const int s = m_imageScale;
+
+    // A pixel of the reduced page covers s x s pixels of the unchanged image : points go to the center of the block
+    for (int index : m_snippetContourIndexes) {
+        for (cv::Point& point : m_contours[index]) {
+            point = point * s + cv::Point((s - 1) / 2, (s - 1) / 2);
+        }
+    }
+    for (cv::Rect& rect : m_boundingBoxes) {
+        rect = cv::Rect(rect.x * s, rect.y * s, rect.width * s, rect.height * s);
+    }
+    for (cv::Point& center : m_snippetCenters) {
+        center = center * s + cv::Point((s - 1) / 2, (s - 1) / 2);
+    }
+    m_vectorRight *= s;
+    m_vectorBottom *= s;
+    m_snippetArea *= s * s;
+
+    // The boxes moved
+    buildSpatialHash();
+}
+
+
+
 void SnippetExtractor::findSnippetCenters() {
     // Clear the previous centers
     m_snippetCenters.clear();
 
     // For each contour, find the bounding box and the center
-    for(int i = 0 ; i < m_snippetContours.size(); i++){
+    for(int i = 0 ; i < m_snippetContourIndexes.size(); i++){
         // Find the bouding box
         cv::Rect rect(m_boundingBoxes[i]);
 
@@ -261,29 +1074,15 @@ void SnippetExtractor::findSnippetCenters() {
 
 
 void SnippetExtractor::findTopLeftSnippet() {
-    // Anonym struct
-    struct SnippetCenter{
-        int index;
-        int x, y;
-    };
-
-    // Create a vector of Snippet centers (with indexes)
-    std::vector<SnippetCenter> centers;
-    for(int i = 0 ; i < m_snippetCenters.size(); i++) {
-        SnippetCenter c;
-        c.index = i;
-        c.x = m_snippetCenters[i].x;
-        c.y = m_snippetCenters[i].y;
-
-        centers.push_back(c);
+    // Take the center with the min sum of x and y as the first snippet
+    m_firstSnippet = 0;
+    for(int i = 1 ; i < m_snippetCenters.size(); i++) {
+        const cv::Point& c = m_snippetCenters[i];
+        const cv::Point& first = m_snippetCenters[m_firstSnippet];
+        if (c.x + c.y < first.x + first.y) {
+            m_firstSnippet = i;
+        }
     }
-
-    // Sort by sum of x and y
-    std::sort(centers.begin(), centers.end(),
-              [] (const SnippetCenter& p1, const SnippetCenter& p2) {return p1.x+p1.y < p2.x+p2.y;});
-
-    // Take the min as the first snippet
-    m_firstSnippet = centers[0].index;
 }
 
 
@@ -341,8 +1140,11 @@ void SnippetExtractor::buildIndexGrid() {
     // Position of the first snippet center
     cv::Point firstPosition = m_snippetCenters[m_firstSnippet];
 
+    // Start from an empty grid
+    clearIndexGrid();
+
     // Add the first snippet
-    m_indexgrid.push_back({m_firstSnippet});
+    addGridRow(m_firstSnippet);
 
     // Row and Column number
     int nRow = 0;
@@ -370,7 +1172,7 @@ void SnippetExtractor::buildIndexGrid() {
         int nextIndex = getSnippetIndexAt(firstPosition + nRow * m_vectorBottom);
 
         if(nextIndex != -1){
-            m_indexgrid.push_back({nextIndex});
+            addGridRow(nextIndex);
             foundBottomSnippet = true;
         }
         else
@@ -381,6 +1183,29 @@ void SnippetExtractor::buildIndexGrid() {
 
 
 
+void SnippetExtractor::clearIndexGrid() {
+    // The rows are kept aside with their capacity, in reverse order so that they are taken back in the same order
+    for (auto it = m_indexgrid.rbegin(); it != m_indexgrid.rend(); ++it) {
+        m_spareRows.push_back(std::move(*it));
+    }
+    m_indexgrid.clear();
+}
+
+
+
+void SnippetExtractor::addGridRow(int firstIndex) {
+    if (m_spareRows.empty()) {
+        m_indexgrid.emplace_back();
+    } else {
+        m_indexgrid.push_back(std::move(m_spareRows.back()));
+        m_spareRows.pop_back();
+        m_indexgrid.back().clear();
+    }
+    m_indexgrid.back().push_back(firstIndex);
+}
+
+
+
 long SnippetExtractor::distance(const cv::Point &p1, const cv::Point &p2) const {
     long dx = p1.x - p2.x;
     long dy = p1.y - p2.y;
@@ -406,12 +1231,23 @@ bool SnippetExtractor::hasSnippetSize(double area) const {
 
 
 int SnippetExtractor::getSnippetIndexAt(const cv::Point &point) const {
-    // For each bounding box
-    for(int i = 0; i < m_boundingBoxes.size(); i++){
-        const cv::Rect& rect = m_boundingBoxes[i];
+    // Only the boxes of the bucket containing the point can contain it
+    if (point.x < 0 || point.y < 0) {
+        return -1;
+    }
+    int col = point.x / m_bucketSize;
+    int row = point.y / m_bucketSize;
+    if (col >= m_bucketCols || row >= m_bucketRows) {
+        return -1;
+    }
+
+    // For each bounding box of the bucket
+    int bucket = row * m_bucketCols + col;
+    for (int b = m_bucketStart[bucket]; b < m_bucketStart[bucket + 1]; b++) {
+        int i = m_bucketBoxes[b];
 
         // Return the index if it contains the point
-        if(rect.contains(point)) {
+        if (m_boundingBoxes[i].contains(point)) {
             return i;
         }
     }
@@ -420,20 +1256,20 @@ int SnippetExtractor::getSnippetIndexAt(const cv::Point &point) const {
 }
 
 void SnippetExtractor::getReferences(const cv::Mat &image, std::vector<cv::Mat> &references) const {
+    const cv::Mat& source = m_extractionMode == ExtractionMode::PageDeskew ? m_deskewedImage : image;
     double width = getIconSize();
     for (int i = 0; i< getNumberRows(); i++) {
         cv::Point center = getIconCenter(i);
-        center.x = center.x - (m_vectorRight.x/10);
-        cv::Rect crop_region(center.x - width/2, center.y - width/2,width, width);
-        references.push_back(image(crop_region));
+        center.x = center.x - (int) (m_vectorRight.x * layout().referenceShift);
+        references.push_back(cropSquare(source, center, width));
     }
 }
 
 void SnippetExtractor::getFormID(const cv::Mat &image, cv::Mat &references) const {
+    const cv::Mat& source = m_extractionMode == ExtractionMode::PageDeskew ? m_deskewedImage : image;
     double width = getIconSize();
     cv::Point center = getIconCenter(0);
-    center.x = center.x - m_vectorRight.x/10;
-    center.y = center.y - m_vectorBottom.y;
-    cv::Rect crop_region(center.x - width/2, center.y - width/2,width, width);
-    references = image(crop_region);
+    center.x = center.x - (int) (m_vectorRight.x * layout().referenceShift);
+    center.y = center.y - (int) (m_vectorBottom.y * layout().idRowShift);
+    references = cropSquare(source, center, width);
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "utility/SnippetInfo.hpp"
+
+void SnippetInfo::writeText(std::ostream& txt) const {
+    // Putting comments
+    txt << "# Groupe 7 | INFO 4" << std::endl;
+    txt << "# Members : " << std::endl;
+    txt << "# ROBERT   Mathis      |   HU     Romain" << std::endl;
+    txt << "# Nicaudie Charlotte   |   MALLAM GABRA Dakini" << std::endl;
+
+    // Putting Data
+    txt << "label " << label << std::endl;
+    txt << "form " << scripter << page << std::endl;
+    txt << "scripter " << scripter << std::endl;
+    txt << "page " << page << std::endl;
+    txt << "row " << row << std::endl;
+    txt << "column " << column << std::endl;
+    txt << "size " << size << std::endl;
+}
+
+std::string SnippetInfo::getName() const {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
@@ -0,0 +1,167 @@
+#include "utility/SnippetManifest.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+const std::string SnippetManifest::header = "path,label,size,scripter,page,row,column";
+
+namespace {
+
+    // Quotes a field if it contains a separator or a quote
+    std::string escape(const std::string& field) {
+        if (field.find_first_of(",\"\n") == std::string::npos) {
+            return field;
+        }
+        std::string res = "\"";
+        for (char c : field) {
+            if (c == '"') res += '"';
+            res += c;
+        }
+        return res + "\"";
+    }
+
+    // Reads a CSV record, which goes on over the next lines while a quoted field is open
+    // (the quotes of a field are doubled : an odd number of quotes means that a field is still open)
+    bool readRecord(std::istream& stream, std::string& record) {
+        if (!getline(stream, record)) {
+            return false;
+        }
+        std::string line;
+        while (std::count(record.begin(), record.end(), '"') % 2 == 1 && getline(stream, line)) {
+            record += '\n';
+            record += line;
+        }
+        return true;
+    }
+
+    // Splits a CSV record into its fields
+    std::vector<std::string> split(const std::string& line) {
+        std::vector<std::string> fields(1);
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (quoted) {
+                if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                    fields.back() += '"';
+                    i++;
+                } else if (c == '"') {
+                    quoted = false;
+                } else {
+                    fields.back() += c;
+                }
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                fields.emplace_back();
+            } else {
+                fields.back() += c;
+            }
+        }
+        return fields;
+    }
+
+    // Returns the list of a key, or an empty list if the key is not in the map
+    const std::vector<size_t>* find(const std::map<std::string, std::vector<size_t>>& index, const std::string& key) {
+        static const std::vector<size_t> none;
+        auto it = index.find(key);
+        return it != index.end() ? &it->second : &none;
+    }
+
+}
+
+//===============// Manifest //===============//
+
+SnippetManifest::SnippetManifest(const std::string& path) : file(path, std::ios::trunc) {
+    // Error management
+    if (!file) {
+        std::cerr << "Could not create the manifest: " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    file << header << '\n';
+}
+
+void SnippetManifest::append(const SnippetInfo& info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file << escape(info.path) << ',' << escape(info.label) << ',' << escape(info.size) << ','
+         << escape(info.scripter) << ',' << escape(info.page) << ',' << info.row << ',' << info.column << '\n';
+}
+
+void SnippetManifest::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+}
+
+bool SnippetManifest::load(const std::string& path, std::vector<SnippetInfo>& infos) {
+    std::ifstream readFile(path);
+    std::string line;
+    if (!readFile || !getline(readFile, line) || line != header) {
+        return false;
+    }
+
+    while (readRecord(readFile, line)) {
+        std::vector<std::string> fields = split(line);
+        if (fields.size() != 7) {
+            std::cerr << "Invalid line in the manifest " << path << ": " << line << std::endl;
+            continue;
+        }
+        SnippetInfo info;
+        info.path = fields[0];
+        info.label = fields[1];
+        info.size = fields[2];
+        info.scripter = fields[3];
+        info.page = fields[4];
+        info.row = std::strtoul(fields[5].c_str(), nullptr, 10);
+        info.column = std::strtoul(fields[6].c_str(), nullptr, 10);
+        infos.push_back(info);
+    }
+    return true;
+}
+
+//===============// Index //===============//
+
+SnippetManifestIndex::SnippetManifestIndex(std::vector<SnippetInfo> infos) : infos(std::move(infos)) {
+    for (size_t i = 0; i < this->infos.size(); i++) {
+        byLabel[this->infos[i].label].push_back(i);
+        byScripter[this->infos[i].scripter].push_back(i);
+        byPage[this->infos[i].page].push_back(i);
+        byName[this->infos[i].getName()] = i;
+    }
+}
+
+const SnippetInfo* SnippetManifestIndex::findByName(const std::string& name) const {
+    auto it = byName.find(name);
+    return it != byName.end() ? &infos[it->second] : nullptr;
+}
+
+std::vector<size_t> SnippetManifestIndex::select(const std::string& label, const std::string& scripter,
+                                                 const std::string& page) const {
+    // Start from the smallest list among the given keys
+    const std::vector<size_t>* candidates = nullptr;
+    if (!label.empty()) candidates = find(byLabel, label);
+    if (!scripter.empty()) {
+        const std::vector<size_t>* list = find(byScripter, scripter);
+        if (!candidates || list->size() < candidates->size()) candidates = list;
+    }
+    if (!page.empty()) {
+        const std::vector<size_t>* list = find(byPage, page);
+        if (!candidates || list->size() < candidates->size()) candidates = list;
+    }
+
+    std::vector<size_t> res;
+    if (!candidates) {
+        // No key given : every snippet matches
+        for (size_t i = 0; i < infos.size(); i++) res.push_back(i);
+        return res;
+    }
+
+    // Then check the other keys
+    for (size_t i : *candidates) {
+        const SnippetInfo& info = infos[i];
+        if ((label.empty() || info.label == label) && (scripter.empty() || info.scripter == scripter) &&
+            (page.empty() || info.page == page)) {
+            res.push_back(i);
+        }
+    }
+    return res;
+}
@@ -0,0 +1,213 @@
+#include "utility/SnippetPack.hpp"
+#include "utility/BinaryIO.hpp"
+#include "utility/SnippetManifest.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+using namespace binaryio;
+
+namespace {
+
+    // Magic numbers at the beginning and at the end of a pack
+    const char packMagic[8] = {'T', 'I', 'V', 'P', 'A', 'C', 'K', '1'};
+    const char indexMagic[8] = {'T', 'I', 'V', 'I', 'N', 'D', 'E', 'X'};
+
+    // Size of the footer : index offset, number of entries and magic
+    const size_t footerSize = 2 * sizeof(uint64_t) + sizeof(indexMagic);
+
+    // Smallest entry of the index : offset, length, row, column and 5 empty strings
+    const size_t minEntrySize = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + 5 * sizeof(uint16_t);
+
+}
+
+//===============// Writer //===============//
+
+SnippetPackWriter::SnippetPackWriter(const std::string& path, SnippetManifest* manifest) :
+        path(path), file(path, std::ios::binary | std::ios::trunc), offset(sizeof(packMagic)), closed(false),
+        failed(false), manifest(manifest) {
+    file.write(packMagic, sizeof(packMagic));
+
+    // Error management
+    if (!file) {
+        std::cerr << "Could not create the pack file: " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+SnippetPackWriter::~SnippetPackWriter() {
+    close();
+}
+
+void SnippetPackWriter::consume(const cv::Mat& snippet, const SnippetInfo& info) {
+    std::vector<uchar> png;
+    cv::imencode(".png", snippet, png);
+    append(png, info);
+}
+
+void SnippetPackWriter::append(const std::vector<uchar>& png, const SnippetInfo& info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+        std::cerr << "The pack is closed, snippet dropped: " << info.path << std::endl;
+        return;
+    }
+    if (failed) {
+        return;
+    }
+
+    // A short write (full or disconnected volume) loses the snippet and every later one
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    if (!file) {
+        std::cerr << "Could not write in the pack file: " << path << " (from " << info.path << ")" << std::endl;
+        failed = true;
+        return;
+    }
+    entries.push_back(SnippetPackEntry{offset, png.size(), info});
+    offset += png.size();
+
+    if (manifest) {
+        manifest->append(info);
+    }
+}
+
+void SnippetPackWriter::whenSaved(const std::function<void()>& callback) {
+    // The snippets are written by consume : they are saved unless a write failed
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!failed) {
+        callback();
+    }
+}
+
+bool SnippetPackWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+        return !failed;
+    }
+    closed = true;
+
+    // The index
+    for (const SnippetPackEntry& entry : entries) {
+        writeValue<uint64_t>(file, entry.offset);
+        writeValue<uint64_t>(file, entry.length);
+        writeInfo(file, entry.info);
+    }
+
+    // The footer
+    writeValue<uint64_t>(file, offset);
+    writeValue<uint64_t>(file, entries.size());
+    file.write(indexMagic, sizeof(indexMagic));
+    file.close();
+
+    // Error management
+    if (failed || !file) {
+        std::cerr << "The pack file is incomplete: " << path << std::endl;
+        failed = true;
+        return false;
+    }
+    std::cout << "Packed " << entries.size() << " snippets in " << path << std::endl;
+    return true;
+}
+
+//===============// Reader //===============//
+
+SnippetPackReader::SnippetPackReader(const std::string& path) : data(nullptr), size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open the pack file: " << path << std::endl;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = static_cast<const uchar*>(mapped);
+            size = st.st_size;
+        }
+    }
+    ::close(fd);
+
+    if (data != nullptr && !readIndex()) {
+        std::cerr << "Invalid pack file: " << path << std::endl;
+        munmap(const_cast<uchar*>(data), size);
+        data = nullptr;
+        entries.clear();
+        byName.clear();
+    }
+}
+
+SnippetPackReader::~SnippetPackReader() {
+    if (data != nullptr) {
+        munmap(const_cast<uchar*>(data), size);
+    }
+}
+
+bool SnippetPackReader::readIndex() {
+    if (size < sizeof(packMagic) + footerSize || std::memcmp(data, packMagic, sizeof(packMagic)) != 0) {
+        return false;
+    }
+
+    // The footer gives the position of the index
+    const uchar* end = data + size;
+    const uchar* cursor = end - footerSize;
+    uint64_t indexOffset, count;
+    readValue(cursor, end, indexOffset);
+    readValue(cursor, end, count);
+    if (std::memcmp(cursor, indexMagic, sizeof(indexMagic)) != 0 ||
+        indexOffset < sizeof(packMagic) || indexOffset > size - footerSize) {
+        return false;
+    }
+
+    // Read the entries (a corrupted count cannot be larger than what the index can hold)
+    const uchar* indexEnd = end - footerSize;
+    cursor = data + indexOffset;
+    if (count > (uint64_t) (indexEnd - cursor) / minEntrySize) {
+        return false;
+    }
+    entries.resize(count);
+    for (SnippetPackEntry& entry : entries) {
+        if (!readValue(cursor, indexEnd, entry.offset) || !readValue(cursor, indexEnd, entry.length) ||
+            !readInfo(cursor, indexEnd, entry.info)) {
+            return false;
+        }
+
+        // The PNG data must be between the magic and the index (compared without overflow on a corrupted entry)
+        // and small enough to be wrapped by a cv::Mat
+        if (entry.offset < sizeof(packMagic) || entry.length > indexOffset ||
+            entry.offset > indexOffset - entry.length || entry.length > INT_MAX) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        byName[entries[i].info.getName()] = i;
+    }
+    return true;
+}
+
+bool SnippetPackReader::findByName(const std::string& name, size_t& index) const {
+    auto it = byName.find(name);
+    if (it == byName.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+cv::Mat SnippetPackReader::decode(size_t index) const {
+    const SnippetPackEntry& entry = entries.at(index);
+    if (entry.length > INT_MAX) {
+        return cv::Mat();
+    }
+
+    // Wrap the mapped bytes without copying them
+    cv::Mat png(1, (int) entry.length, CV_8U, const_cast<uchar*>(data + entry.offset));
+    return cv::imdecode(png, cv::IMREAD_COLOR);
+}
@@ -0,0 +1,40 @@
+#include "utility/SnippetSink.hpp"
+#include "utility/SnippetManifest.hpp"
+
+#include <iostream>
+#include <fstream>
+
+#include <opencv2/imgcodecs.hpp>
+
+DiskSnippetSink::DiskSnippetSink(SnippetManifest* manifest) : manifest(manifest) {}
+
+void DiskSnippetSink::consume(const cv::Mat& snippet, const SnippetInfo& info) {
+    // Save the Snippet picture
+    cv::imwrite(info.path + ".png", snippet);
+
+    // The metadata goes to the manifest if there is one
+    if (manifest) {
+        manifest->append(info);
+        return;
+    }
+
+    // Write the Txt File
+    std::ofstream txt(info.path + ".txt");
+
+    // If the file opened
+    if(txt){
+        info.writeText(txt);
+
+        // Close the file
+        txt.close();
+    }
+    else{
+        std::cout << "Could not open file " << info.path << ".txt" << std::endl;
+    }
+}
+
+CallbackSnippetSink::CallbackSnippetSink(Callback callback) : callback(std::move(callback)) {}
+
+void CallbackSnippetSink::consume(const cv::Mat& snippet, const SnippetInfo& info) {
+    callback(snippet, info);
+}
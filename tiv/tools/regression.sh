@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Compare the snippets extracted by this tree with the snippets of a baseline revision
+#
+# Both trees are built, then run on the same forms with each configuration below :
+# the png and txt files they write must be identical, byte for byte.
+#
+# Usage : tools/regression.sh [FORMS_DIR] [BASELINE_REV]
+#   FORMS_DIR      the forms to extract (default : the sample forms of cmake-build-debug/donnees)
+#   BASELINE_REV   the revision giving the expected snippets (default : 82961f8, before the optimizations)
+#
+
+set -eu
+
+TIV=$(cd "$(dirname "$0")/.." && pwd)
+FORMS=$(cd "${1:-$TIV/cmake-build-debug/donnees}" && pwd)
+BASELINE_REV=${2:-82961f8}
+WORK=$(mktemp -d)
+
+cleanup() {
+    git -C "$TIV" worktree remove --force "$WORK/baseline" 2>/dev/null || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+#===============// Build //===============//
+
+build() {
+    cmake -S "$1" -B "$2" -DCMAKE_BUILD_TYPE=Release > "$2.log" 2>&1 &&
+    cmake --build "$2" -j"$(nproc)" >> "$2.log" 2>&1 ||
+    { echo "Could not build $1 :"; tail -20 "$2.log"; exit 1; }
+}
+
+git -C "$TIV" worktree add --detach "$WORK/baseline" "$BASELINE_REV" > /dev/null 2>&1
+build "$WORK/baseline/tiv" "$WORK/build-baseline"
+build "$TIV" "$WORK/build-current"
+
+#===============// Run //===============//
+
+# Run a build on the forms, in its own directory : run NAME TREE BUILD [OPTIONS...]
+# (the forms are read from ./donnees, the references from ../base2 and the snippets written in ./output)
+run() {
+    runDir="$WORK/runs-$1"
+    mkdir -p "$runDir/run"
+    ln -s "$2/base2" "$runDir/base2"
+    ln -s "$FORMS" "$runDir/run/donnees"
+    executable="$3/Projet_OpenCV_CMake"
+    shift 3
+    (cd "$runDir/run" && "$executable" "$@" > ../log 2>&1) ||
+    { echo "The run failed :"; tail -20 "$runDir/log"; exit 1; }
+}
+
+run baseline "$WORK/baseline/tiv" "$WORK/build-baseline"
+nbSnippets=$(find "$WORK/runs-baseline/run/output" -name '*.png' | wc -l)
+echo "Baseline : $nbSnippets snippets"
+
+#===============// Compare //===============//
+
+failures=0
+
+# Run this tree with the given options and compare its snippets : check NAME [OPTIONS...]
+check() {
+    name=$1
+    shift
+    run "$name" "$TIV" "$WORK/build-current" "$@"
+    if diff -r -q "$WORK/runs-baseline/run/output" "$WORK/runs-$name/run/output" > "$WORK/$name.diff"; then
+        echo "$name : identical"
+    else
+        echo "$name : $(wc -l < "$WORK/$name.diff") files differ"
+        sed "s|$WORK/||g; s/^/    /" "$WORK/$name.diff" | head -20
+        failures=$((failures + 1))
+    fi
+}
+
+# Detection by contours, spatial hash of the boxes, snippets deskewed one by one
+check default
+
+# One form at a time : the bands of each page are binarized in parallel by OpenCV's threads
+check one-thread --threads 1
+
+# Detection by connected components
+check components --components
+
+# A layout that no page matches : every page falls back on the detection of the snippets
+printf 'page 100000 100000\norigin 0 0\nright 1 0\nbottom 0 1\ngrid 1 1\nsnippet 1\n' > "$WORK/unmatched.layout"
+check layout-fallback --layout "$WORK/unmatched.layout"
+
+[ "$failures" -eq 0 ]